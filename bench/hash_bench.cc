@@ -0,0 +1,483 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+/*
+  Hash throughput and quality benchmark for snow's hash functions.
+
+  Usage: snow-hash-bench [--quick] [throughput] [short] [avalanche] [bias]
+                         [collisions]
+
+  With no section names, runs every section. --quick cuts iteration counts
+  down for a fast sanity check; numbers from a quick run aren't meaningful.
+
+  To compare a new hash function against the existing ones, add it to
+  g_hashes below -- every section runs over every entry.
+*/
+
+
+#include <snow/data/hash.hh>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+#if S_SIMD_DISPATCH
+#include <x86intrin.h>
+#endif
+
+
+namespace {
+
+
+/// Hash functions under test
+
+using hash_fn_t = uint64_t (*)(const char *str, size_t length, uint64_t seed);
+
+struct hash_entry_t
+{
+  const char *name;
+  hash_fn_t   fn;
+  // Number of significant bits in the result.
+  int         bits;
+};
+
+
+
+uint64_t bench_hash32(const char *str, size_t length, uint64_t seed)
+{
+  return snow::hash32(str, length, uint32_t(seed));
+}
+
+
+
+uint64_t bench_hash64(const char *str, size_t length, uint64_t seed)
+{
+  return snow::hash64(str, length, seed);
+}
+
+
+
+uint64_t bench_hash64_block(const char *str, size_t length, uint64_t seed)
+{
+  return snow::hash64_block(str, length, seed);
+}
+
+
+
+const hash_entry_t g_hashes[] = {
+  { "hash32",       bench_hash32,       32 },
+  { "hash64",       bench_hash64,       64 },
+  { "hash64_block", bench_hash64_block, 64 },
+};
+
+
+
+bool g_quick = false;
+
+// Results are accumulated here so the optimizer can't discard the hashing.
+volatile uint64_t g_sink = 0;
+
+
+
+/// Timing
+
+using bench_clock_t = std::chrono::steady_clock;
+
+double seconds_since(bench_clock_t::time_point start)
+{
+  return std::chrono::duration<double>(bench_clock_t::now() - start).count();
+}
+
+
+
+uint64_t read_cycles()
+{
+#if S_SIMD_DISPATCH
+  return __rdtsc();
+#else
+  return 0;
+#endif
+}
+
+
+
+/// Key sets
+
+std::vector<char> random_bytes(size_t length, uint64_t seed)
+{
+  std::mt19937_64 rng(seed);
+  std::vector<char> bytes(length);
+  for (char &byte : bytes) {
+    byte = char(rng());
+  }
+  return bytes;
+}
+
+
+
+// Paths shaped like asset paths: few distinct directories, numbered files.
+std::vector<std::string> path_keys(size_t count)
+{
+  static const char *const dirs[] = {
+    "textures", "models", "sounds", "shaders", "maps", "scripts", "fonts"
+  };
+  static const char *const exts[] = { ".png", ".obj", ".ogg", ".glsl", ".json" };
+  std::vector<std::string> keys;
+  keys.reserve(count);
+  char buffer[128];
+  for (size_t index = 0; index < count; ++index) {
+    std::snprintf(buffer, sizeof(buffer), "assets/%s/level_%zu/item_%zu%s",
+                  dirs[index % 7], index / 977, index % 977, exts[index % 5]);
+    keys.emplace_back(buffer);
+  }
+  return keys;
+}
+
+
+
+// Identifiers built from common words, e.g. "getPlayerCount".
+std::vector<std::string> identifier_keys(size_t count)
+{
+  static const char *const prefixes[] = {
+    "get", "set", "is", "has", "on", "make", "find", "update"
+  };
+  static const char *const words[] = {
+    "Player", "Count", "Index", "Name", "Value", "Buffer", "Texture", "State",
+    "Size", "Position", "Shader", "Frame", "Event", "Handle", "Entity", "Node"
+  };
+  std::vector<std::string> keys;
+  keys.reserve(count);
+  for (size_t index = 0; keys.size() < count; ++index) {
+    std::string key = prefixes[index % 8];
+    size_t rest = index / 8;
+    do {
+      key += words[rest % 16];
+      rest /= 16;
+    } while (rest != 0);
+    keys.push_back(std::move(key));
+  }
+  return keys;
+}
+
+
+
+// Sequential integers, stored as their native bytes.
+std::vector<std::string> integer_keys(size_t count, size_t width)
+{
+  std::vector<std::string> keys;
+  keys.reserve(count);
+  for (uint64_t index = 0; index < count; ++index) {
+    keys.emplace_back((const char *)&index, width);
+  }
+  return keys;
+}
+
+
+
+/// Sections
+
+/*==============================================================================
+  bench_throughput()
+
+    Hashes buffers from 4 bytes to 1 MB and reports GB/s. Each size is hashed
+    repeatedly for a fixed amount of time.
+==============================================================================*/
+void bench_throughput()
+{
+  const size_t max_size = 1 << 20;
+  const double duration = g_quick ? 0.01 : 0.25;
+  const std::vector<char> data = random_bytes(max_size, 1);
+
+  std::printf("\n== Throughput (GB/s) ==\n%10s", "size");
+  for (const hash_entry_t &entry : g_hashes) {
+    std::printf(" %14s", entry.name);
+  }
+  std::printf("\n");
+
+  for (size_t size = 4; size <= max_size; size *= 4) {
+    std::printf("%10zu", size);
+    for (const hash_entry_t &entry : g_hashes) {
+      uint64_t result = 0;
+      uint64_t iterations = 0;
+      const bench_clock_t::time_point start = bench_clock_t::now();
+      double elapsed;
+      do {
+        for (int rep = 0; rep < 64; ++rep) {
+          result += entry.fn(data.data(), size, result);
+        }
+        iterations += 64;
+      } while ((elapsed = seconds_since(start)) < duration);
+      g_sink = g_sink + result;
+      std::printf(" %14.3f", double(size) * iterations / elapsed / 1e9);
+    }
+    std::printf("\n");
+  }
+
+  // The parallel hash isn't a drop-in hash_fn_t, since it's only useful for
+  // large inputs, so it's measured on its own.
+  const size_t parallel_size = g_quick ? (8 << 20) : (256 << 20);
+  const std::vector<char> large = random_bytes(parallel_size, 2);
+  for (unsigned threads : { 1U, 0U }) {
+    const bench_clock_t::time_point start = bench_clock_t::now();
+    g_sink = g_sink + snow::hash64_parallel(large.data(), large.size(),
+                                            snow::DEFAULT_HASH_SEED_64, threads);
+    std::printf("hash64_parallel, %zu MB, %s: %.3f GB/s\n", parallel_size >> 20,
+                threads ? "1 thread" : "all threads",
+                double(parallel_size) / seconds_since(start) / 1e9);
+  }
+}
+
+
+
+/*==============================================================================
+  bench_short_keys()
+
+    Reports the latency of hashing short keys one at a time, in nanoseconds
+    and TSC ticks per key. Each hash is seeded with the previous result so
+    that calls can't overlap.
+==============================================================================*/
+void bench_short_keys()
+{
+  const uint64_t count = g_quick ? 100000 : 10000000;
+  const std::vector<char> data = random_bytes(64, 3);
+
+  std::printf("\n== Short keys (ns / ticks per key) ==\n%10s", "size");
+  for (const hash_entry_t &entry : g_hashes) {
+    std::printf(" %20s", entry.name);
+  }
+  std::printf("\n");
+
+  for (size_t size : { 4, 8, 12, 16, 24, 32, 48, 64 }) {
+    std::printf("%10zu", size);
+    for (const hash_entry_t &entry : g_hashes) {
+      uint64_t result = 0;
+      const bench_clock_t::time_point start = bench_clock_t::now();
+      const uint64_t start_cycles = read_cycles();
+      for (uint64_t index = 0; index < count; ++index) {
+        result = entry.fn(data.data(), size, result);
+      }
+      const uint64_t cycles = read_cycles() - start_cycles;
+      const double elapsed = seconds_since(start);
+      g_sink = g_sink + result;
+      std::printf(" %10.2f / %7.1f", elapsed * 1e9 / count,
+                  double(cycles) / count);
+    }
+    std::printf("\n");
+  }
+}
+
+
+
+/*==============================================================================
+  bench_avalanche()
+
+    For random keys, flips each input bit in turn and records how often each
+    output bit changes. Ideally every output bit flips half the time. Reports
+    the worst bias over all input/output bit pairs, as a percentage where 0%
+    is ideal and 100% means an output bit never or always flips.
+==============================================================================*/
+void bench_avalanche()
+{
+  const int trials = g_quick ? 2000 : 100000;
+  std::mt19937_64 rng(4);
+
+  std::printf("\n== Avalanche (worst bias %%) ==\n%10s", "size");
+  for (const hash_entry_t &entry : g_hashes) {
+    std::printf(" %14s", entry.name);
+  }
+  std::printf("\n");
+
+  for (size_t size : { 4, 8, 16, 32, 64 }) {
+    std::printf("%10zu", size);
+    const size_t input_bits = size * 8;
+    for (const hash_entry_t &entry : g_hashes) {
+      std::vector<uint32_t> flips(input_bits * entry.bits, 0);
+      std::vector<char> key(size);
+      for (int trial = 0; trial < trials; ++trial) {
+        for (char &byte : key) {
+          byte = char(rng());
+        }
+        const uint64_t base = entry.fn(key.data(), size, snow::DEFAULT_HASH_SEED_64);
+        for (size_t bit = 0; bit < input_bits; ++bit) {
+          key[bit / 8] ^= char(1 << (bit % 8));
+          const uint64_t diff =
+            base ^ entry.fn(key.data(), size, snow::DEFAULT_HASH_SEED_64);
+          key[bit / 8] ^= char(1 << (bit % 8));
+          for (int out = 0; out < entry.bits; ++out) {
+            flips[bit * entry.bits + out] += uint32_t((diff >> out) & 1);
+          }
+        }
+      }
+
+      double worst = 0;
+      for (uint32_t count : flips) {
+        worst = std::max(worst, std::fabs(2.0 * count / trials - 1.0));
+      }
+      std::printf(" %14.2f", worst * 100);
+    }
+    std::printf("\n");
+  }
+}
+
+
+
+/*==============================================================================
+  bench_bias()
+
+    Hashes sequential integer keys and records how often each output bit is
+    set. Ideally each bit is set half the time. Reports the worst bias over
+    all output bits, as a percentage.
+==============================================================================*/
+void bench_bias()
+{
+  const size_t count = g_quick ? 100000 : 4000000;
+
+  std::printf("\n== Output bit bias, sequential keys (worst bias %%) ==\n");
+  for (const hash_entry_t &entry : g_hashes) {
+    std::vector<uint64_t> ones(entry.bits, 0);
+    for (uint64_t index = 0; index < count; ++index) {
+      const uint64_t hash = entry.fn((const char *)&index, sizeof(index),
+                                     snow::DEFAULT_HASH_SEED_64);
+      for (int bit = 0; bit < entry.bits; ++bit) {
+        ones[bit] += (hash >> bit) & 1;
+      }
+    }
+
+    double worst = 0;
+    for (uint64_t set : ones) {
+      worst = std::max(worst, std::fabs(2.0 * set / count - 1.0));
+    }
+    std::printf("%14s %8.3f\n", entry.name, worst * 100);
+  }
+}
+
+
+
+/*==============================================================================
+  count_collisions(hashes)
+
+    Sorts the hashes and returns the number that are equal to their
+    predecessor.
+==============================================================================*/
+size_t count_collisions(std::vector<uint64_t> &hashes)
+{
+  std::sort(hashes.begin(), hashes.end());
+  size_t collisions = 0;
+  for (size_t index = 1; index < hashes.size(); ++index) {
+    collisions += hashes[index] == hashes[index - 1];
+  }
+  return collisions;
+}
+
+
+
+/*==============================================================================
+  bench_collisions()
+
+    Hashes realistic key sets and counts collisions in the full hash and in its
+    low 32 bits, alongside the number of collisions expected from a random
+    function (n^2 / 2^(bits + 1)).
+==============================================================================*/
+void bench_collisions()
+{
+  const size_t count = g_quick ? 20000 : 2000000;
+
+  struct key_set_t
+  {
+    const char               *name;
+    std::vector<std::string>  keys;
+  };
+
+  const key_set_t key_sets[] = {
+    { "paths",       path_keys(count) },
+    { "identifiers", identifier_keys(count) },
+    { "int32",       integer_keys(count, 4) },
+    { "int64",       integer_keys(count, 8) },
+  };
+
+  const double expected_32 = double(count) * count / 8589934592.0;
+  std::printf("\n== Collisions, %zu keys (full / low 32 bits; expected %.2f "
+              "in 32 bits, ~0 in 64) ==\n%12s", count, expected_32, "keys");
+  for (const hash_entry_t &entry : g_hashes) {
+    std::printf(" %20s", entry.name);
+  }
+  std::printf("\n");
+
+  std::vector<uint64_t> full(count);
+  std::vector<uint64_t> low(count);
+  for (const key_set_t &set : key_sets) {
+    std::printf("%12s", set.name);
+    for (const hash_entry_t &entry : g_hashes) {
+      for (size_t index = 0; index < count; ++index) {
+        const std::string &key = set.keys[index];
+        full[index] = entry.fn(key.data(), key.size(), snow::DEFAULT_HASH_SEED_64);
+        low[index] = full[index] & 0xFFFFFFFFULL;
+      }
+      const size_t full_collisions = count_collisions(full);
+      const size_t low_collisions = count_collisions(low);
+      std::printf(" %9zu / %8zu", full_collisions, low_collisions);
+    }
+    std::printf("\n");
+  }
+}
+
+
+} // namespace <anon>
+
+
+
+int main(int argc, const char **argv)
+{
+  struct section_t
+  {
+    const char *name;
+    void      (*run)();
+    bool        enabled;
+  };
+
+  section_t sections[] = {
+    { "throughput", bench_throughput, false },
+    { "short",      bench_short_keys, false },
+    { "avalanche",  bench_avalanche,  false },
+    { "bias",       bench_bias,       false },
+    { "collisions", bench_collisions, false },
+  };
+
+  bool any_enabled = false;
+  for (int arg = 1; arg < argc; ++arg) {
+    if (std::strcmp(argv[arg], "--quick") == 0) {
+      g_quick = true;
+      continue;
+    }
+
+    bool found = false;
+    for (section_t &section : sections) {
+      if (std::strcmp(argv[arg], section.name) == 0) {
+        section.enabled = found = any_enabled = true;
+      }
+    }
+
+    if (!found) {
+      std::fprintf(stderr, "Unknown argument: %s\n", argv[arg]);
+      return 1;
+    }
+  }
+
+  for (section_t &section : sections) {
+    if (!any_enabled || section.enabled) {
+      section.run();
+    }
+  }
+
+  return 0;
+}
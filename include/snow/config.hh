@@ -72,6 +72,13 @@
 #define S_GNU     (defined(__GNUC__))
 #define S_MSVC    (defined(_MSC_BUILD))
 
+/* SIMD -- S_SIMD_SSE2 and S_SIMD_AVX2 are compile-time guarantees, while
+   S_SIMD_DISPATCH indicates that code may be built for newer instruction sets
+   via target attributes and selected at runtime via __builtin_cpu_supports */
+#define S_SIMD_SSE2       (__SSE2__ || S_ARCH_x86_64 || _M_IX86_FP >= 2)
+#define S_SIMD_AVX2       (__AVX2__)
+#define S_SIMD_DISPATCH   (S_GNU && (S_ARCH_x86_64 || S_ARCH_x86))
+
 #if (S_PLATFORM_UNIX || S_PLATFORM_APPLE) && !defined(__USE_UNIX98)
   #define __USE_UNIX98 1
 #endif
@@ -136,6 +143,17 @@
   #endif
 #endif
 
+#ifndef S_FALLTHROUGH
+  // Marks a switch case as intentionally falling through to the next
+  #if S_CLANG
+    #define S_FALLTHROUGH [[clang::fallthrough]]
+  #elif S_GNU && __GNUC__ >= 7
+    #define S_FALLTHROUGH [[gnu::fallthrough]]
+  #else
+    #define S_FALLTHROUGH
+  #endif
+#endif
+
 #ifdef S_NO_THREAD_LOCAL
   // Check if something else is requesting TLS be disabled
   #ifndef S_THREAD_LOCAL
@@ -49,9 +49,9 @@ S_EXPORT uint32_t hash32(const string &str, uint32_t seed = DEFAULT_HASH_SEED_32
   Produces a 32-bit hash of the input data.
   @param str    The input data.
   @param length The length of the input data.
-  @param seed   The seed for the input. If you want to concatenate string
-  hashes, you can use a previous string hash as the seed and it will be the
-  same as hashing the combined strings.
+  @param seed   The seed for the input. A previous string hash may be used as
+  the seed to chain hashes, but because each byte's position in the input is
+  part of the hash, the result differs from hashing the combined strings.
 */
 S_EXPORT uint32_t hash32(const char *str, const size_t length,
                 uint32_t seed = DEFAULT_HASH_SEED_32);
@@ -66,14 +66,269 @@ S_EXPORT uint64_t hash64(const string &str, uint64_t seed = DEFAULT_HASH_SEED_64
   Produces a 64-bit hash of the input data.
   @param str    The input data.
   @param length The length of the input data.
-  @param seed   The seed for the input. If you want to concatenate string
-  hashes, you can use a previous string hash as the seed and it will be the
-  same as hashing the combined strings.
+  @param seed   The seed for the input. A previous string hash may be used as
+  the seed to chain hashes, but because each byte's position in the input is
+  part of the hash, the result differs from hashing the combined strings. Use
+  snow::hasher64_t for that.
 */
 S_EXPORT uint64_t hash64(const char *str, const size_t length,
                 uint64_t seed = DEFAULT_HASH_SEED_64);
 
 
+/**
+  Produces a 64-bit block hash of the input string.
+  @see snow::hash64_block(const char *, const size_t, uint64_t)
+*/
+S_EXPORT uint64_t hash64_block(const string &str,
+                uint64_t seed = DEFAULT_HASH_SEED_64);
+
+/**
+  Produces a 64-bit hash of the input data, consuming it a word at a time
+  rather than a byte at a time. This is a different hash function from
+  snow::hash64 and produces different results for the same input, so it's not
+  a drop-in replacement for hashes that have already been persisted.
+
+  Input is consumed in 32-byte stripes of four 8-byte words, which are hashed
+  using AVX2 where the CPU supports it. Results are identical regardless of
+  which code path is taken and regardless of host endianness.
+
+  @param str    The input data.
+  @param length The length of the input data.
+  @param seed   The seed for the input. A previous hash may be used as the
+  seed to concatenate hashes. This is exact provided the length of the
+  previous data was a multiple of 8 bytes -- otherwise the result is still
+  deterministic, but differs from hashing the combined data.
+*/
+S_EXPORT uint64_t hash64_block(const char *str, const size_t length,
+                uint64_t seed = DEFAULT_HASH_SEED_64);
+
+
+/**
+  Size of the leaves hash64_parallel splits its input into. Changing this
+  changes the results of hash64_parallel.
+*/
+const size_t HASH_PARALLEL_LEAF_SIZE = 256 * 1024;
+
+/**
+  Produces a 64-bit tree hash of the input string.
+  @see snow::hash64_parallel(const char *, const size_t, uint64_t, unsigned)
+*/
+S_EXPORT uint64_t hash64_parallel(const string &str,
+                uint64_t seed = DEFAULT_HASH_SEED_64,
+                unsigned thread_count = 0);
+
+/**
+  Produces a 64-bit hash of the input data using multiple threads. The input
+  is split into leaves of HASH_PARALLEL_LEAF_SIZE bytes, each leaf is hashed
+  with snow::hash64_block, and the leaf hashes are combined pairwise in a
+  binary tree. The result depends only on the input and seed -- it is the
+  same for any thread count -- but it is a different hash function from both
+  hash64 and hash64_block.
+
+  Only worth using for inputs of several leaves or more. Inputs of a single
+  leaf are hashed on the calling thread.
+
+  @param str          The input data.
+  @param length       The length of the input data.
+  @param seed         The seed for the input.
+  @param thread_count The number of threads to hash with, including the
+  calling thread. If zero, uses std::thread::hardware_concurrency().
+*/
+S_EXPORT uint64_t hash64_parallel(const char *str, const size_t length,
+                uint64_t seed = DEFAULT_HASH_SEED_64,
+                unsigned thread_count = 0);
+
+
+/**
+  Hashes count keys with snow::hash64, storing the hash of keys[n] in out[n].
+  Results are identical to calling hash64 on each key, but where AVX2 is
+  available, eight keys are hashed at a time across two registers of four
+  lanes. Only keys of at least 8 bytes are batched, and only while eight of
+  them remain -- shorter keys and any left over are hashed one at a time.
+
+  @param keys    The keys to hash.
+  @param lengths The length of each key.
+  @param count   The number of keys.
+  @param out     Where to store the hashes. Must have room for count hashes.
+  @param seed    The seed for every key.
+*/
+S_EXPORT void hash64_batch(const char *const *keys, const size_t *lengths,
+                size_t count, uint64_t *out,
+                uint64_t seed = DEFAULT_HASH_SEED_64);
+
+
+/**
+  Mixes a hash so that every input bit affects every output bit (MurmurHash3's
+  64-bit finalizer). hash64 doesn't spread small changes in its input across
+  its output well, so anything taking bits directly from a hash -- such as a
+  table index -- should mix it first. It's a bijection, so it adds no
+  collisions.
+*/
+inline uint64_t hash_mix64(uint64_t hash)
+{
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+
+/** @cond IGNORE */
+// Helpers for const_hash32/const_hash64. C++11 constexpr functions may only
+// consist of a return statement, so the byte loops become tail recursion.
+constexpr uint32_t const_hash_shift(uint32_t curchar)
+{
+  return (((curchar & 0x9) | ((curchar & 0x10) >> 2) | ((curchar & 0x40) >> 5)) ^
+          ((curchar & 0xA) >> 5)) | ((curchar & 0x2) << 2) | ((curchar & 0x4) >> 1);
+}
+
+constexpr uint32_t const_hash32_rotate(uint32_t hash, uint32_t shift)
+{
+  return shift == 0 ? hash : (hash << shift) | (hash >> (32 - shift));
+}
+
+constexpr uint64_t const_hash64_rotate(uint64_t hash, uint64_t shift)
+{
+  return shift == 0 ? hash : (hash << shift) | (hash >> (64 - shift));
+}
+
+constexpr uint32_t const_hash32_at(const char *str, size_t length,
+                                   uint32_t hash, uint32_t index)
+{
+  return index == length
+         ? hash
+         : const_hash32_at(str, length,
+             const_hash32_rotate(
+               hash * 439 + uint32_t(str[index]) * 23 + (index + 257),
+               const_hash_shift(uint32_t(str[index]))),
+             index + 1);
+}
+
+constexpr uint64_t const_hash64_at(const char *str, size_t length,
+                                   uint64_t hash, uint64_t index)
+{
+  return index == length
+         ? hash
+         : const_hash64_at(str, length,
+             const_hash64_rotate(
+               hash * 5741U + uint64_t(str[index]) * 23U + (index + 257U),
+               const_hash_shift(uint32_t(str[index]))),
+             index + 1);
+}
+/** @endcond */
+
+
+/**
+  Compile-time form of snow::hash32. The result is the same as the result of
+  hash32 for the same input, so it can be used for switch cases and static
+  tables that are compared against runtime hashes.
+
+  @note Each byte of input is one level of recursion in constant evaluation,
+  so inputs longer than the compiler's constexpr depth limit (usually 512)
+  can only be hashed at runtime.
+*/
+constexpr uint32_t const_hash32(const char *str, const size_t length,
+                                uint32_t seed = DEFAULT_HASH_SEED_32)
+{
+  return const_hash32_at(str, length, seed, 0);
+}
+
+/**
+  Compile-time form of snow::hash64.
+  @see snow::const_hash32(const char *, const size_t, uint32_t)
+*/
+constexpr uint64_t const_hash64(const char *str, const size_t length,
+                                uint64_t seed = DEFAULT_HASH_SEED_64)
+{
+  return const_hash64_at(str, length, seed, 0);
+}
+
+
+/** User-defined literals for hashing string literals at compile time. */
+namespace literals {
+
+/** Hashes a string literal as const_hash32 does, e.g. "name"_hash32. */
+constexpr uint32_t operator "" _hash32(const char *str, size_t length)
+{
+  return const_hash32(str, length);
+}
+
+/** Hashes a string literal as const_hash64 does, e.g. "name"_hash64. */
+constexpr uint64_t operator "" _hash64(const char *str, size_t length)
+{
+  return const_hash64(str, length);
+}
+
+} // namespace literals
+
+
+/**
+  Incremental form of snow::hash64. Data may be passed to update() in chunks
+  of any size and the result of finish() is the same as calling hash64 once
+  on all of it.
+*/
+struct S_EXPORT hasher64_t
+{
+  /** Constructs a hasher with the given seed, as passed to hash64. */
+  explicit hasher64_t(uint64_t seed = DEFAULT_HASH_SEED_64);
+
+  /** Discards all input and restarts the hasher with the given seed. */
+  void reset(uint64_t seed = DEFAULT_HASH_SEED_64);
+
+  /** Hashes length bytes of data following all previous input. */
+  hasher64_t &update(const void *data, size_t length);
+  /** Hashes the contents of str following all previous input. */
+  hasher64_t &update(const string &str);
+
+  /**
+    Returns the hash of all input so far. Does not modify the hasher, so more
+    data may still be passed to update() afterward.
+  */
+  inline uint64_t finish() const { return hash_; }
+
+  /** Returns the number of bytes hashed so far. */
+  inline uint64_t length() const { return length_; }
+
+private:
+  uint64_t hash_;
+  uint64_t length_;
+};
+
+
+/**
+  Incremental form of snow::hash64_block. Data may be passed to update() in
+  chunks of any size and the result of finish() is the same as calling
+  hash64_block once on all of it. At most one partial word is buffered between
+  updates -- large updates are hashed directly from the input.
+*/
+struct S_EXPORT block_hasher64_t
+{
+  /** Constructs a hasher with the given seed, as passed to hash64_block. */
+  explicit block_hasher64_t(uint64_t seed = DEFAULT_HASH_SEED_64);
+
+  /** Discards all input and restarts the hasher with the given seed. */
+  void reset(uint64_t seed = DEFAULT_HASH_SEED_64);
+
+  /** Hashes length bytes of data following all previous input. */
+  block_hasher64_t &update(const void *data, size_t length);
+  /** Hashes the contents of str following all previous input. */
+  block_hasher64_t &update(const string &str);
+
+  /**
+    Returns the hash of all input so far. Does not modify the hasher, so more
+    data may still be passed to update() afterward.
+  */
+  uint64_t finish() const;
+
+private:
+  uint64_t state_;
+  size_t   pending_length_;
+  char     pending_[8];
+};
+
+
 /** @} */
 
 
@@ -0,0 +1,748 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#pragma once
+
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+#if S_SIMD_AVX2
+#include <immintrin.h>
+#elif S_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace snow {
+namespace sparse {
+
+
+/** @cond IGNORE */
+
+// Gets the escaped form of a given character code
+inline char escaped_char(char ch)
+{
+  switch (ch) {
+  case 'n': case 'N': return '\n';
+  case 'r': case 'R': return '\r';
+  case 'a': case 'A': return '\a';
+  case 'b': case 'B': return '\b';
+  case 'f': case 'F': return '\f';
+  case 't': case 'T': return '\t';
+  case '0':           return '\0';
+  default:            return ch;
+  }
+}
+
+
+
+// Returns whether a character may change the parser's state. Any character
+// that doesn't can be appended to a name or value without further checks.
+inline bool is_structural(char ch)
+{
+  switch (ch) {
+  case ' ': case '\t': case '\n': case '{': case '}': case ';': case '#': case '\\':
+    return true;
+  default:
+    return false;
+  }
+}
+
+
+
+#if S_SIMD_SSE2 || S_SIMD_AVX2
+#define S_SPARSE_MATCH_STRUCTURAL(PREFIX, SET1, BLOCK)                         \
+  PREFIX##_or_si##SET1(                                                        \
+    PREFIX##_or_si##SET1(                                                      \
+      PREFIX##_or_si##SET1(PREFIX##_cmpeq_epi8(BLOCK, PREFIX##_set1_epi8(' ')),  \
+                          PREFIX##_cmpeq_epi8(BLOCK, PREFIX##_set1_epi8('\t'))), \
+      PREFIX##_or_si##SET1(PREFIX##_cmpeq_epi8(BLOCK, PREFIX##_set1_epi8('\n')), \
+                          PREFIX##_cmpeq_epi8(BLOCK, PREFIX##_set1_epi8('{')))),  \
+    PREFIX##_or_si##SET1(                                                      \
+      PREFIX##_or_si##SET1(PREFIX##_cmpeq_epi8(BLOCK, PREFIX##_set1_epi8('}')),  \
+                          PREFIX##_cmpeq_epi8(BLOCK, PREFIX##_set1_epi8(';'))),  \
+      PREFIX##_or_si##SET1(PREFIX##_cmpeq_epi8(BLOCK, PREFIX##_set1_epi8('#')),  \
+                          PREFIX##_cmpeq_epi8(BLOCK, PREFIX##_set1_epi8('\\')))))
+#endif
+
+
+
+// Returns a pointer to the first structural character in [str, end), or end
+// if there is none. Scans 32 or 16 bytes at a time where possible.
+inline const char *find_structural(const char *str, const char *end)
+{
+#if S_SIMD_AVX2
+  while (end - str >= 32) {
+    const __m256i block = _mm256_loadu_si256((const __m256i *)str);
+    const uint32_t mask =
+      uint32_t(_mm256_movemask_epi8(S_SPARSE_MATCH_STRUCTURAL(_mm256, 256, block)));
+    if (mask) {
+      return str + __builtin_ctz(mask);
+    }
+    str += 32;
+  }
+#endif
+
+#if S_SIMD_SSE2
+  while (end - str >= 16) {
+    const __m128i block = _mm_loadu_si128((const __m128i *)str);
+    const uint32_t mask =
+      uint32_t(_mm_movemask_epi8(S_SPARSE_MATCH_STRUCTURAL(_mm, 128, block)));
+    if (mask) {
+      return str + __builtin_ctz(mask);
+    }
+    str += 16;
+  }
+#endif
+
+  while (str < end && !is_structural(*str)) {
+    ++str;
+  }
+  return str;
+}
+
+
+
+#if S_SIMD_SSE2 || S_SIMD_AVX2
+#define S_SPARSE_MATCH_BRACES(PREFIX, SET1, BLOCK)                             \
+  PREFIX##_or_si##SET1(                                                        \
+    PREFIX##_or_si##SET1(PREFIX##_cmpeq_epi8(BLOCK, PREFIX##_set1_epi8('{')),    \
+                        PREFIX##_cmpeq_epi8(BLOCK, PREFIX##_set1_epi8('}'))),    \
+    PREFIX##_or_si##SET1(PREFIX##_cmpeq_epi8(BLOCK, PREFIX##_set1_epi8('#')),    \
+                        PREFIX##_cmpeq_epi8(BLOCK, PREFIX##_set1_epi8('\\'))))
+#endif
+
+
+
+// Returns a pointer to the first brace, comment, or escape in [str, end), or
+// end if there is none -- the only characters that can change the depth.
+inline const char *find_brace(const char *str, const char *end)
+{
+#if S_SIMD_AVX2
+  while (end - str >= 32) {
+    const __m256i block = _mm256_loadu_si256((const __m256i *)str);
+    const uint32_t mask =
+      uint32_t(_mm256_movemask_epi8(S_SPARSE_MATCH_BRACES(_mm256, 256, block)));
+    if (mask) {
+      return str + __builtin_ctz(mask);
+    }
+    str += 32;
+  }
+#endif
+
+#if S_SIMD_SSE2
+  while (end - str >= 16) {
+    const __m128i block = _mm_loadu_si128((const __m128i *)str);
+    const uint32_t mask =
+      uint32_t(_mm_movemask_epi8(S_SPARSE_MATCH_BRACES(_mm, 128, block)));
+    if (mask) {
+      return str + __builtin_ctz(mask);
+    }
+    str += 16;
+  }
+#endif
+
+  while (str < end && *str != '{' && *str != '}' && *str != '#' && *str != '\\') {
+    ++str;
+  }
+  return str;
+}
+
+#undef S_SPARSE_MATCH_STRUCTURAL
+#undef S_SPARSE_MATCH_BRACES
+
+
+
+// Returns a pointer to the '}' closing the node whose contents begin at str,
+// or end if the node isn't closed. Nothing in the node is parsed beyond what
+// it takes to match braces.
+inline const char *find_node_end(const char *str, const char *end)
+{
+  size_t depth = 1;
+  for (; (str = find_brace(str, end)) < end; ++str) {
+    switch (*str) {
+    case '{':
+      depth += 1;
+      break;
+    case '}':
+      if (--depth == 0) {
+        return str;
+      }
+      break;
+    case '#':
+      str = (const char *)std::memchr(str, '\n', size_t(end - str));
+      if (!str) {
+        return end;
+      }
+      break;
+    default: // Skip the escaped character
+      if (++str == end) {
+        return end;
+      }
+      break;
+    }
+  }
+  return end;
+}
+
+
+
+// Returns the number of newlines in [str, end).
+inline size_t count_newlines(const char *str, const char *end)
+{
+  size_t count = 0;
+
+#if S_SIMD_SSE2
+  // Matches are -1, so subtracting them counts newlines per byte lane. Lanes
+  // are summed before they can overflow, every 255 blocks at most.
+  const __m128i newline = _mm_set1_epi8('\n');
+  const __m128i zero = _mm_setzero_si128();
+  while (end - str >= 16) {
+    __m128i lanes = zero;
+    for (int blocks = 0; blocks < 255 && end - str >= 16; ++blocks, str += 16) {
+      const __m128i block = _mm_loadu_si128((const __m128i *)str);
+      lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(block, newline));
+    }
+    const __m128i sums = _mm_sad_epu8(lanes, zero);
+    count += size_t(_mm_cvtsi128_si32(sums)) +
+             size_t(_mm_cvtsi128_si32(_mm_srli_si128(sums, 8)));
+  }
+#endif
+
+  for (; str < end; ++str) {
+    count += (*str == '\n');
+  }
+  return count;
+}
+
+
+
+// Only pausable handlers need a paused() method.
+template <typename Handler>
+inline bool handler_paused(const Handler &, std::false_type)
+{
+  return false;
+}
+
+template <typename Handler>
+inline bool handler_paused(const Handler &handler, std::true_type)
+{
+  return handler.paused();
+}
+
+
+
+/// parse_state_t::position_stack_t
+
+inline void parse_state_t::position_stack_t::push(const position_t &pos)
+{
+  if (size_ < INLINE_DEPTH) {
+    inline_[size_] = pos;
+  } else if (size_ - INLINE_DEPTH < heap_.size()) {
+    heap_[size_ - INLINE_DEPTH] = pos;
+  } else {
+    heap_.push_back(pos);
+  }
+  size_ += 1;
+}
+
+
+
+inline position_t &parse_state_t::position_stack_t::operator [] (size_t index)
+{
+  return index < INLINE_DEPTH ? inline_[index] : heap_[index - INLINE_DEPTH];
+}
+
+
+
+inline const position_t &parse_state_t::position_stack_t::top() const
+{
+  const size_t index = size_ - 1;
+  return index < INLINE_DEPTH ? inline_[index] : heap_[index - INLINE_DEPTH];
+}
+
+
+
+/// parse_state_t
+
+template <bool TRIM, typename Handler>
+inline void parse_state_t::send_token(source_kind_t kind, Handler &handler)
+{
+  // Unlike send_string, send the starting position for a token instead of the
+  // current reader position
+  const char *str = view ? view : buffer.data();
+  size_t length = view ? view_length : size_t(buffer.size());
+  if (TRIM) {
+    length -= space_count;
+    space_count = 0;
+  }
+  handler(kind, str, length, start);
+  view = nullptr;
+  view_length = 0;
+  buffer.clear();
+}
+
+
+
+template <typename Handler>
+inline void parse_state_t::send_string(source_kind_t kind, const char *str,
+                                       size_t length, position_t at,
+                                       Handler &handler)
+{
+  handler(kind, str, length, at);
+}
+
+
+
+template <bool LAZY>
+inline position_t parse_state_t::token_position(const char *source,
+                                                const char *at) const
+{
+  const size_t at_offset = offset + size_t(at - source);
+  if (LAZY) {
+    return position_t { 0, 0, at_offset };
+  }
+  return position_t { pos.line, pos.column, at_offset };
+}
+
+
+
+template <bool LAZY>
+inline const position_t &parse_state_t::update_position(const char *source,
+                                                        const char *at)
+{
+  pos.offset = offset + size_t(at - source);
+  if (LAZY) {
+    const size_t lines = count_newlines(counted, at);
+    if (lines > 0) {
+      // Find the start of the last line counted
+      const char *last = at;
+      while (last[-1] != '\n') {
+        --last;
+      }
+      pos.line += lines;
+      line_start = offset + size_t(last - source);
+    }
+    counted = at;
+    pos.column = pos.offset - line_start + 1;
+  }
+  return pos;
+}
+
+
+
+template <bool LAZY>
+inline void parse_state_t::count_lines(const char *source, const char *at)
+{
+  if (LAZY) {
+    // Openings pushed since lines were last counted have only their offsets.
+    // They're on top of the stack in order, so lines are still only counted
+    // once.
+    size_t index = openings.size();
+    while (index > 0 && openings[index - 1].line == 0) {
+      --index;
+    }
+    for (; index < openings.size(); ++index) {
+      position_t &opening = openings[index];
+      opening = update_position<true>(source, source + (opening.offset - offset));
+    }
+  }
+  update_position<LAZY>(source, at);
+}
+
+
+
+template <bool LAZY>
+inline void parse_state_t::finish_source(const char *source, const char *at)
+{
+  count_lines<LAZY>(source, at);
+  offset = pos.offset;
+  counted = nullptr;
+}
+
+
+
+inline void parse_state_t::skip_source(const char *from, const char *to)
+{
+  const size_t lines = count_newlines(from, to);
+  if (lines > 0) {
+    const char *last = to;
+    while (last[-1] != '\n') {
+      --last;
+    }
+    pos.line += lines;
+    pos.column = size_t(to - last) + 1;
+    line_start = offset + size_t(last - from);
+  } else {
+    pos.column += size_t(to - from);
+  }
+  offset += size_t(to - from);
+  pos.offset = offset;
+}
+
+
+
+template <bool TRIM>
+inline void parse_state_t::buffer_char(const char *at, char c)
+{
+  if (c != ' ' || escaped)
+    space_count = 0;
+  else if (TRIM)
+    space_count += 1;
+
+  if (view && at == view + view_length) {
+    // Still contiguous with the source
+    view_length += 1;
+  } else if (!view && at && buffer.empty()) {
+    view = at;
+    view_length = 1;
+  } else {
+    spill_view();
+    buffer.push_back(c);
+  }
+}
+
+
+
+inline void parse_state_t::buffer_run(const char *at, size_t length)
+{
+  space_count = 0;
+
+  if (view && at == view + view_length) {
+    view_length += length;
+  } else if (!view && buffer.empty()) {
+    view = at;
+    view_length = length;
+  } else {
+    spill_view();
+    buffer.append(at, string::size_type(length));
+  }
+}
+
+
+
+inline void parse_state_t::spill_view()
+{
+  if (view) {
+    buffer.append(view, string::size_type(view_length));
+    view = nullptr;
+    view_length = 0;
+  }
+}
+
+
+
+template <typename Handler>
+void parse_state_t::close_with_error(const string &error, Handler &handler)
+{
+  if (closed)
+    s_throw(std::runtime_error, "Attempt to close with error when already closed.");
+  send_string(SP_ERROR, error.data(), size_t(error.size()), pos, handler);
+  this->error = error;
+  closed = true;
+  view = nullptr;
+  view_length = 0;
+}
+
+
+
+/// Parsing
+
+template <int Options, bool Pausable, typename Handler>
+size_t parse_source(parse_state_t &state, Handler &handler, const char *source,
+                    size_t length)
+{
+  using state_t = parse_state_t;
+
+  constexpr bool consume_ws = (Options & SP_CONSUME_WHITESPACE) == SP_CONSUME_WHITESPACE;
+  constexpr bool trim_spaces = (Options & SP_TRIM_TRAILING_SPACES) == SP_TRIM_TRAILING_SPACES;
+  // Nameless nodes necessitates support for nameless roots
+  constexpr bool nameless_roots = (Options & SP_NAMELESS_ROOT_NODES) == SP_NAMELESS_ROOT_NODES;
+  constexpr bool nameless_nodes = (Options & SP_NAMELESS_NODES) == SP_NAMELESS_NODES;
+  // Lazy positions skip counting lines and columns until they're needed
+  constexpr bool lazy = (Options & SP_LAZY_POSITIONS) == SP_LAZY_POSITIONS;
+
+  if (state.closed)
+    s_throw(std::runtime_error, "Attempt to add source to closed parser.");
+
+  const char *source_cst = source;
+  const char *source_cst_end = source_cst + length;
+  state.counted = source;
+
+  for (; source_cst < source_cst_end; ++source_cst) {
+    // Stop between characters if the handler asks to, leaving any token
+    // being read as a view into the remaining source.
+    if (handler_paused(handler, std::integral_constant<bool, Pausable>())) {
+      state.finish_source<lazy>(source, source_cst);
+      return size_t(source_cst - source);
+    }
+
+    if (state.mode == state_t::READ_COMMENT) {
+      // Skip to the end of the line, if it's in this source.
+      const char *const newline = (const char *)std::memchr(
+        source_cst, '\n', size_t(source_cst_end - source_cst));
+      if (!newline) {
+        if (!lazy)
+          state.pos.column += size_t(source_cst_end - source_cst);
+        state.last_char = source_cst_end[-1];
+        break;
+      }
+      if (!lazy)
+        state.pos.column += size_t(newline - source_cst);
+      source_cst = newline;
+    }
+
+    const char current = *source_cst;
+
+    if (state.mode == state_t::READ_COMMENT) {
+      // If in a comment, read until the end of the line. In all cases, if an
+      // end of line occurs, the next mode will necessarily be FIND_NAME (this
+      // is because it's impossible to end a line with a comment without
+      // also ending a value or name if one was being read).
+      state.mode = state_t::FIND_NAME;
+    } else if (state.escaped) {
+      // Handle escaped character
+      state.buffer_char<trim_spaces>(nullptr, escaped_char(current));
+      state.escaped = false;
+    } else {
+      // Generic parsing
+      switch (current) {
+      case ' ':  // Whitespace
+      case '\t': // Whitespace
+        if ((consume_ws && state.last_char == current) ||
+            state.mode == state_t::FIND_NAME || state.mode == state_t::FIND_VALUE) {
+          // NOP
+        } else if (state.mode == state_t::READ_NAME) {
+          state.send_token<trim_spaces>(SP_NAME, handler);
+          state.mode = state_t::FIND_VALUE;
+        } else {
+          state.buffer_char<trim_spaces>(source_cst, current);
+        }
+        break; // END ' ' & '\t'
+
+      case '{': // Start of node
+        switch (state.mode) {
+        case state_t::READ_NAME:
+          state.send_token<trim_spaces>(SP_NAME, handler);
+          S_FALLTHROUGH;
+        case state_t::FIND_VALUE:
+          state.openings.push(state.token_position<lazy>(source, source_cst));
+          state.send_string(SP_OPEN_NODE, "{", 1,
+                            state.token_position<lazy>(source, source_cst), handler);
+          break;
+
+        case state_t::READ_VALUE:
+          state.send_token<trim_spaces>(SP_VALUE, handler);
+          S_FALLTHROUGH;
+        case state_t::FIND_NAME:
+          if ((nameless_roots && state.openings.size() == 0) || nameless_nodes) {
+            const position_t at = state.token_position<lazy>(source, source_cst);
+            state.openings.push(at);
+            state.send_string(SP_NAME, "", 0, at, handler);
+            state.send_string(SP_OPEN_NODE, "{", 1, at, handler);
+          } else {
+            default:
+            state.update_position<lazy>(source, source_cst);
+            state.close_with_error(state.error_at_pos("Invalid character '{' - expected name."),
+                                   handler);
+            return length;
+          }
+        }
+        state.mode = state_t::FIND_NAME;
+        break; // END '{'
+
+      case '}':  // Ened of node
+      case '\n': // End-line terminator
+      case ';':  // Inline terminator
+      case '#':  // Comment
+        switch (state.mode) {
+        case state_t::READ_NAME:
+          state.send_token<trim_spaces>(SP_NAME, handler);
+          S_FALLTHROUGH;
+        case state_t::FIND_VALUE:
+          state.send_string(SP_VALUE, "", 0,
+                            state.token_position<lazy>(source, source_cst), handler);
+          break;
+        case state_t::READ_VALUE:
+          state.send_token<trim_spaces>(SP_VALUE, handler);
+          break;
+        default: break;
+        }
+
+        if (current == '}') {
+          // End of node
+          if (state.openings.size() == 0) {
+            state.update_position<lazy>(source, source_cst);
+            state.close_with_error(state.error_at_pos("Unexpected '}' - no matching '{'."),
+                                   handler);
+            return length;
+          }
+          state.openings.pop();
+          state.mode = state_t::FIND_NAME;
+          state.send_string(SP_CLOSE_NODE, "}", 1,
+                            state.token_position<lazy>(source, source_cst), handler);
+        } // if (current == '}')
+
+        state.mode = state_t::FIND_NAME << (4 * (current == '#'));
+        break;
+
+      case '\\': // Escape
+        if (state.mode < state_t::READ_NAME) { // an escape may begin a token
+          state.mode <<= 2;
+          state.start = state.token_position<lazy>(source, source_cst);
+        }
+        state.escaped = true;
+        break;
+
+      default:
+        if (state.mode < state_t::READ_NAME) { // if mode is find_name or find_value
+          state.mode <<= 2;                     // shift it to read_name or read_value
+          state.start = state.token_position<lazy>(source, source_cst); // and store the token's starting pos
+        }
+
+        {
+          // Append the whole run of ordinary characters starting here at
+          // once, rather than going around the loop for each of them.
+          const char *const run_end = find_structural(source_cst + 1, source_cst_end);
+          const size_t run_length = size_t(run_end - source_cst);
+          state.buffer_run(source_cst, run_length);
+          if (!lazy)
+            state.pos.column += run_length;
+          state.last_char = run_end[-1];
+          source_cst = run_end - 1;
+        }
+        continue;
+      }
+    }
+
+    if (lazy) {
+      // Count lines a block at a time while they're still in cache, rather
+      // than all at once when the source is finished.
+      if (current == '\n' && size_t(source_cst - state.counted) >= state_t::LINE_COUNT_BLOCK) {
+        state.count_lines<lazy>(source, source_cst);
+      }
+    } else if (current == '\n') {
+      state.pos.line += 1;
+      state.pos.column = 1;
+    } else {
+      state.pos.column += 1;
+    }
+
+    state.last_char = current;
+  }
+
+  state.finish_source<lazy>(source, source_cst_end);
+
+  // The source may not outlive this call, so anything still being read out
+  // of it has to be copied.
+  state.spill_view();
+  return length;
+}
+
+
+
+template <typename Handler>
+void parse_close(parse_state_t &state, Handler &handler)
+{
+  using state_t = parse_state_t;
+
+  if (state.closed)
+    s_throw(std::runtime_error, "Attempt to close already-closed parser.");
+
+  // Whether or not spaces are trimmed, any trailing spaces were counted only
+  // if trimming is enabled, so trimming here is correct either way.
+  switch (state.mode) {
+  case state_t::READ_NAME:  state.send_token<true>(SP_NAME, handler); S_FALLTHROUGH;
+  case state_t::FIND_VALUE: state.send_string(SP_VALUE, "", 0, state.pos, handler); break;
+  case state_t::READ_VALUE: state.send_token<true>(SP_VALUE, handler); break;
+  default: break;
+  }
+
+  if (state.openings.size() > 0) {
+    state.close_with_error(state.unclosed_error(), handler);
+    return;
+  }
+
+  state.buffer.resize(0);
+  state.closed = true;
+
+  state.send_string(SP_DONE, "", 0, state.pos, handler);
+}
+
+/** @endcond */
+
+
+
+/// basic_parser
+
+template <typename Handler, int Options>
+basic_parser<Handler, Options>::basic_parser(Handler handler) :
+  handler_(std::move(handler))
+{
+  /* nop */
+}
+
+
+
+template <typename Handler, int Options>
+void basic_parser<Handler, Options>::add_source(const string &source)
+{
+  parse_source<Options>(state_, handler_, source.data(), size_t(source.size()));
+}
+
+
+
+template <typename Handler, int Options>
+void basic_parser<Handler, Options>::add_source(const char *source, size_t length)
+{
+  parse_source<Options>(state_, handler_, source, length);
+}
+
+
+
+template <typename Handler, int Options>
+void basic_parser<Handler, Options>::close()
+{
+  parse_close(state_, handler_);
+}
+
+
+
+template <typename Handler, int Options>
+void basic_parser<Handler, Options>::reset()
+{
+  state_.reset();
+}
+
+
+
+
+/// parse_file
+
+template <int Options, typename Handler>
+bool parse_file(const char *path, Handler &handler)
+{
+  mapped_file_t file;
+  if (!file.open(path, mapped_file_t::ACCESS_SEQUENTIAL)) {
+    handler(SP_ERROR, file.error().data(), size_t(file.error().size()), position_t { 0, 0, 0 });
+    return false;
+  }
+
+  parse_state_t state;
+  parse_source<Options>(state, handler, file.data(), file.size());
+  if (!state.closed) {
+    parse_close(state, handler);
+  }
+  return state.error.empty();
+}
+
+
+} // namespace sparse
+} // namespace snow
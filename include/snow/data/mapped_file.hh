@@ -0,0 +1,84 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#pragma once
+
+#include <snow/config.hh>
+#include <vector>
+
+
+namespace snow {
+
+
+/**
+  @brief A read-only view of a file's contents.
+
+  Regular files are memory-mapped, so their contents are paged in as they're
+  read rather than copied into memory up front. Anything that can't be mapped
+  (e.g., a pipe) is read into a buffer instead, so data() is usable either
+  way.
+*/
+struct S_EXPORT mapped_file_t
+{
+  /** How the mapping is expected to be read. Passed on to the OS. */
+  enum access_hint_t : int
+  {
+    ACCESS_NORMAL,
+    /** Read front to back, once. Allows aggressive read-ahead. */
+    ACCESS_SEQUENTIAL,
+    /** Read in no particular order. Disables read-ahead. */
+    ACCESS_RANDOM,
+  };
+
+
+  mapped_file_t() = default;
+  /**
+    Opens the file at path. Throws std::runtime_error if the file can't be
+    opened.
+  */
+  explicit mapped_file_t(const char *path, access_hint_t hint = ACCESS_NORMAL);
+  mapped_file_t(mapped_file_t &&other);
+  ~mapped_file_t();
+
+  mapped_file_t &operator = (mapped_file_t &&other);
+
+  mapped_file_t(const mapped_file_t &) = delete;
+  mapped_file_t &operator = (const mapped_file_t &) = delete;
+
+  /**
+    Opens the file at path, closing any previously open file. Returns false
+    if the file can't be opened, in which case error() says why.
+  */
+  bool open(const char *path, access_hint_t hint = ACCESS_NORMAL);
+  /** Unmaps and closes the file. */
+  void close();
+
+  /** Returns whether a file is open. */
+  inline bool is_open() const { return open_; }
+  /** Returns the file's contents. May be null if the file is empty. */
+  inline const char *data() const { return data_; }
+  /** Returns the size of the file's contents in bytes. */
+  inline size_t size() const { return size_; }
+  /** Returns whether the contents are memory-mapped rather than buffered. */
+  inline bool is_mapped() const { return mapped_; }
+  /** Returns why the last call to open() failed. */
+  inline const string &error() const { return error_; }
+
+private:
+  const char        *data_   = nullptr;
+  size_t             size_   = 0;
+  bool               open_   = false;
+  bool               mapped_ = false;
+  // Holds the contents of files that couldn't be mapped.
+  std::vector<char>  buffer_;
+  string             error_;
+};
+
+
+} // namespace snow
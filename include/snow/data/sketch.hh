@@ -0,0 +1,317 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#pragma once
+
+#include <snow/config.hh>
+#include <snow/data/buffer_stream.hh>
+#include <snow/data/hash.hh>
+#include <snow/memory/allocator.hh>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+
+/**
+  @file
+  @ingroup Sketches
+*/
+
+
+namespace snow {
+
+/**
+  @addtogroup Sketches Probabilistic Sketches
+  @{
+
+  Approximate set membership, counting, and cardinality structures. All of
+  them hash keys with snow::hash64 using the seed they were constructed with,
+  and can be given a key's hash directly (via the *_hash methods) if it's
+  already known.
+
+  Two sketches of the same kind constructed with the same parameters and seed
+  can be merged, so separate threads can each fill their own sketch without
+  locking and combine them afterward. Sketches with different parameters or
+  seeds can't be merged -- merge throws std::invalid_argument.
+
+  Each sketch can be serialized to and from a buffer_stream_t. The format is
+  in host byte order, so it is only suitable for exchange between hosts of the
+  same endianness.
+*/
+
+
+/**
+  @brief A Bloom filter split into cache-line sized blocks.
+
+  Every bit for a key is set in the same 64-byte block, so adding or testing a
+  key touches one cache line. This costs a slightly higher false positive rate
+  than a standard Bloom filter of the same size.
+*/
+struct S_EXPORT bloom_filter_t
+{
+  /** Size of a block in bytes. */
+  static const size_t BLOCK_SIZE = 64;
+
+
+  /**
+    Constructs an empty filter sized to hold expected_items keys with roughly
+    the given false positive rate.
+  */
+  bloom_filter_t(size_t expected_items, double false_positive_rate,
+                 uint64_t seed = DEFAULT_HASH_SEED_64);
+  bloom_filter_t(const bloom_filter_t &other);
+  bloom_filter_t(bloom_filter_t &&other) = default;
+
+  bloom_filter_t &operator = (const bloom_filter_t &other);
+  bloom_filter_t &operator = (bloom_filter_t &&other) = default;
+
+  /** Adds a key to the filter. */
+  void add(const char *str, size_t length);
+  void add(const string &str);
+  void add_hash(uint64_t hash);
+
+  /**
+    Returns whether a key may be in the filter. False positives are possible,
+    false negatives are not.
+  */
+  bool contains(const char *str, size_t length) const;
+  bool contains(const string &str) const;
+  bool contains_hash(uint64_t hash) const;
+
+  /** Removes all keys. */
+  void clear();
+
+  /** Adds all keys in other to this filter. */
+  void merge(const bloom_filter_t &other);
+
+  /** Returns the number of blocks in the filter. */
+  inline size_t block_count() const { return block_count_; }
+  /** Returns the number of bits set per key. */
+  inline unsigned hash_count() const { return hash_count_; }
+  inline uint64_t seed() const { return seed_; }
+
+  /** Returns the number of bytes needed to serialize the filter. */
+  size_t serialized_size() const;
+  /**
+    Writes the filter to the stream. Returns the number of bytes written, or
+    zero if the stream is too small, in which case nothing is written.
+  */
+  size_t serialize(buffer_stream_t &out) const;
+  /**
+    Replaces the filter with one read from the stream. Returns false and
+    leaves both the filter and the stream unchanged if the stream doesn't
+    contain a valid filter.
+  */
+  bool deserialize(const buffer_stream_t &in);
+
+private:
+  using block_allocator_t = aligned_mallocator<BLOCK_SIZE>;
+  using blocks_t = std::unique_ptr<uint64_t[], block_allocator_t::deallocator_type>;
+
+  bloom_filter_t(size_t block_count, unsigned hash_count, uint64_t seed);
+
+  static blocks_t allocate_blocks(size_t block_count);
+
+  size_t   block_count_;
+  unsigned hash_count_;
+  uint64_t seed_;
+  blocks_t blocks_;
+};
+
+
+
+/**
+  @brief A cuckoo filter, an approximate set supporting removal.
+
+  Stores a 16-bit fingerprint of each key in one of two buckets of four. Keys
+  may be removed, but only keys that were added -- removing a key that was
+  never added may remove another key with the same fingerprint. The same key
+  can be added at most 2 * BUCKET_SIZE times.
+
+  Unlike a Bloom filter, a cuckoo filter can fill up: add returns false when
+  there is no room for a key, after which the filter is full and further adds
+  fail. The filter is never full below roughly 95% occupancy.
+*/
+struct S_EXPORT cuckoo_filter_t
+{
+  /** Number of fingerprints per bucket. */
+  static const size_t BUCKET_SIZE = 4;
+
+
+  /** Constructs an empty filter with room for at least capacity keys. */
+  explicit cuckoo_filter_t(size_t capacity,
+                           uint64_t seed = DEFAULT_HASH_SEED_64);
+
+  /**
+    Adds a key to the filter. Returns false if the filter is full, in which
+    case the filter is left unchanged.
+  */
+  bool add(const char *str, size_t length);
+  bool add(const string &str);
+  bool add_hash(uint64_t hash);
+
+  /**
+    Removes a key from the filter. Returns whether a matching fingerprint was
+    found and removed.
+  */
+  bool remove(const char *str, size_t length);
+  bool remove(const string &str);
+  bool remove_hash(uint64_t hash);
+
+  /**
+    Returns whether a key may be in the filter. False positives are possible,
+    false negatives are not (provided only added keys are removed).
+  */
+  bool contains(const char *str, size_t length) const;
+  bool contains(const string &str) const;
+  bool contains_hash(uint64_t hash) const;
+
+  /** Removes all keys. */
+  void clear();
+
+  /**
+    Adds all keys in other to this filter. Returns false if this filter fills
+    up, in which case only some of other's keys were added.
+  */
+  bool merge(const cuckoo_filter_t &other);
+
+  /** Returns the number of keys in the filter. */
+  inline size_t size() const { return size_; }
+  /** Returns the number of buckets in the filter. */
+  inline size_t bucket_count() const { return buckets_.size() / BUCKET_SIZE; }
+  inline uint64_t seed() const { return seed_; }
+
+  /** @see bloom_filter_t::serialized_size() */
+  size_t serialized_size() const;
+  /** @see bloom_filter_t::serialize(buffer_stream_t &) */
+  size_t serialize(buffer_stream_t &out) const;
+  /** @see bloom_filter_t::deserialize(const buffer_stream_t &) */
+  bool deserialize(const buffer_stream_t &in);
+
+private:
+  bool insert(size_t bucket, uint16_t fingerprint);
+  size_t alt_bucket(size_t bucket, uint16_t fingerprint) const;
+
+  uint64_t              seed_;
+  size_t                size_;
+  uint64_t              kick_state_;
+  std::vector<uint16_t> buckets_;
+};
+
+
+
+/**
+  @brief A count-min sketch for approximate frequency counting.
+
+  Estimates never undercount. With probability 1 - delta, an estimate
+  overcounts by at most epsilon times the total of all counts added.
+  Counters saturate at UINT32_MAX.
+*/
+struct S_EXPORT count_min_sketch_t
+{
+  /**
+    Constructs an empty sketch whose estimates are within epsilon * total of
+    the true count with probability 1 - delta.
+  */
+  count_min_sketch_t(double epsilon, double delta,
+                     uint64_t seed = DEFAULT_HASH_SEED_64);
+
+  /** Adds count occurrences of a key. */
+  void add(const char *str, size_t length, uint32_t count = 1);
+  void add(const string &str, uint32_t count = 1);
+  void add_hash(uint64_t hash, uint32_t count = 1);
+
+  /** Returns the estimated number of occurrences of a key. */
+  uint32_t estimate(const char *str, size_t length) const;
+  uint32_t estimate(const string &str) const;
+  uint32_t estimate_hash(uint64_t hash) const;
+
+  /** Resets all counts to zero. */
+  void clear();
+
+  /** Adds all counts in other to this sketch. */
+  void merge(const count_min_sketch_t &other);
+
+  /** Returns the total of all counts added. */
+  inline uint64_t total() const { return total_; }
+  inline size_t width() const { return width_; }
+  inline size_t depth() const { return depth_; }
+  inline uint64_t seed() const { return seed_; }
+
+  /** @see bloom_filter_t::serialized_size() */
+  size_t serialized_size() const;
+  /** @see bloom_filter_t::serialize(buffer_stream_t &) */
+  size_t serialize(buffer_stream_t &out) const;
+  /** @see bloom_filter_t::deserialize(const buffer_stream_t &) */
+  bool deserialize(const buffer_stream_t &in);
+
+private:
+  size_t                width_;
+  size_t                depth_;
+  uint64_t              seed_;
+  uint64_t              total_;
+  std::vector<uint32_t> counters_;
+};
+
+
+
+/**
+  @brief A HyperLogLog cardinality estimator.
+
+  Estimates the number of distinct keys added using 2^precision one-byte
+  registers. The standard error is about 1.04 / sqrt(2^precision), so the
+  default precision of 14 (16 KB) gives an error of roughly 0.8%.
+*/
+struct S_EXPORT hyperloglog_t
+{
+  static const unsigned MIN_PRECISION = 4;
+  static const unsigned MAX_PRECISION = 18;
+
+
+  /**
+    Constructs an empty estimator. Throws std::invalid_argument if precision
+    is outside [MIN_PRECISION, MAX_PRECISION].
+  */
+  explicit hyperloglog_t(unsigned precision = 14,
+                         uint64_t seed = DEFAULT_HASH_SEED_64);
+
+  /** Adds a key. */
+  void add(const char *str, size_t length);
+  void add(const string &str);
+  void add_hash(uint64_t hash);
+
+  /** Returns the estimated number of distinct keys added. */
+  double estimate() const;
+
+  /** Resets the estimator to empty. */
+  void clear();
+
+  /** Adds all keys in other to this estimator. */
+  void merge(const hyperloglog_t &other);
+
+  inline unsigned precision() const { return precision_; }
+  inline uint64_t seed() const { return seed_; }
+
+  /** @see bloom_filter_t::serialized_size() */
+  size_t serialized_size() const;
+  /** @see bloom_filter_t::serialize(buffer_stream_t &) */
+  size_t serialize(buffer_stream_t &out) const;
+  /** @see bloom_filter_t::deserialize(const buffer_stream_t &) */
+  bool deserialize(const buffer_stream_t &in);
+
+private:
+  unsigned             precision_;
+  uint64_t             seed_;
+  std::vector<uint8_t> registers_;
+};
+
+
+/** @} */
+
+} // namespace snow
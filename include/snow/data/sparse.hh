@@ -10,11 +10,12 @@
 #pragma once
 
 #include <snow/config.hh>
+#include <snow/data/mapped_file.hh>
 
 #include <functional>
 #include <iostream>
-#include <stack>
 #include <stdexcept>
+#include <vector>
 
 
 namespace snow {
@@ -73,6 +74,16 @@ enum option_flags_t : int
     This flag implies SP_NAMELESS_ROOT_NODES.
   */
   SP_NAMELESS_NODES       = 0x1 << 3 | SP_NAMELESS_ROOT_NODES,
+  /**
+    Tells the parser to track only byte offsets while parsing, rather than
+    lines and columns. Positions passed to the parser's callback then have a
+    valid offset, but their line and column should be ignored -- use a
+    line_index_t over the source to find them when needed. Error messages
+    still give the exact line and column of the error.
+
+    Not supported by reader_t or document_t, which ignore it.
+  */
+  SP_LAZY_POSITIONS       = 0x1 << 4,
   /** Default parser options. Essentially an or-ing of all flags. */
   SP_DEFAULT_OPTIONS      = (SP_TRIM_TRAILING_SPACES |
                              SP_NAMELESS_NODES |
@@ -88,6 +99,8 @@ struct S_EXPORT position_t {
   size_t line;
   /** The column in the document. */
   size_t column;
+  /** The byte offset from the start of the document. */
+  size_t offset;
 
   operator string() const;
 };
@@ -96,6 +109,43 @@ struct S_EXPORT position_t {
 S_EXPORT std::ostream &operator << (std::ostream&, const position_t&);
 
 
+
+/**
+  @brief Finds the line and column of offsets in a Sparse source.
+
+  For use with SP_LAZY_POSITIONS. The index of the source's lines is built
+  the first time it's needed, so if no position is ever looked up, the source
+  is never scanned. Lookups are a binary search over the lines.
+
+  The source isn't copied and must outlive the index. As building the index
+  modifies it, an index shared between threads should be built (by looking
+  up any position) before it's shared.
+*/
+struct S_EXPORT line_index_t
+{
+  /** Constructs an index of the given source. */
+  line_index_t(const char *source, size_t length);
+
+  /** Returns the position of the byte at offset, or of the end of the source
+      if offset is past it. */
+  position_t position(size_t offset) const;
+  /** Returns pos with its line and column filled in from its offset. */
+  inline position_t resolve(position_t pos) const { return position(pos.offset); }
+
+  /** Returns the number of lines in the source. */
+  size_t line_count() const;
+
+private:
+  void build() const;
+
+  const char                 *source_;
+  size_t                      length_;
+  // Offsets of the start of each line after the first
+  mutable std::vector<size_t> line_starts_;
+  mutable bool                built_;
+};
+
+
 /**
   The parser function provided to a parser_t.
   @param kind The kind of element the parser encountered.
@@ -106,11 +156,233 @@ S_EXPORT std::ostream &operator << (std::ostream&, const position_t&);
 using parse_func_t = std::function<void(source_kind_t kind, const string &str, position_t pos)>;
 
 
-/** The Sparse parser class. */
+/**
+  A parser function that receives a view of each element rather than a
+  string. Where possible, the view points directly into the source passed to
+  parser_t::add_source, so nothing is copied. Elements that span more than one
+  add_source call or that had to be rewritten (because of escapes or consumed
+  whitespace) are copied into the parser's buffer first.
+
+  The view is only valid for the duration of the call and is not
+  NUL-terminated.
+
+  @param kind   The kind of element the parser encountered.
+  @param str    The start of the element's text.
+  @param length The length of the element's text.
+  @param pos    Where the element was encountered.
+*/
+using view_func_t = std::function<void(source_kind_t kind, const char *str, size_t length, position_t pos)>;
+
+
+/** @cond IGNORE */
+/**
+  Parser state shared by basic_parser and parser_t. Not meant to be used
+  directly.
+*/
+struct S_EXPORT parse_state_t
+{
+  enum parse_mode_t : int
+  {
+    FIND_NAME    = 0x1 << 0,
+    FIND_VALUE   = 0x1 << 1,
+    READ_NAME    = 0x1 << 2,
+    READ_VALUE   = 0x1 << 3,
+    READ_COMMENT = 0x1 << 4,
+  };
+
+  // A stack of the positions of open nodes. The first INLINE_DEPTH are kept
+  // in the stack itself, so documents nested no deeper than that never
+  // allocate, and any heap storage past them is kept when the stack is
+  // cleared.
+  struct position_stack_t
+  {
+    static const size_t INLINE_DEPTH = 16;
+
+    position_stack_t() : size_(0) {}
+
+    void push(const position_t &pos);
+    inline void pop() { size_ -= 1; }
+    const position_t &top() const;
+    position_t &operator [] (size_t index);
+    inline size_t size() const { return size_; }
+    inline bool empty() const { return size_ == 0; }
+    inline void clear() { size_ = 0; }
+
+  private:
+    position_t              inline_[INLINE_DEPTH];
+    std::vector<position_t> heap_;
+    size_t                  size_;
+  };
+
+
+  // With lazy positions, lines are counted once at least this many bytes of
+  // the current source haven't been.
+  static const size_t LINE_COUNT_BLOCK = 32768;
+
+
+  parse_state_t();
+
+  // Returns the state to how it was when constructed, keeping any storage
+  // allocated for the buffer, error, and openings.
+  void reset();
+
+  bool closed;
+  position_t pos;
+  position_t start;
+
+  size_t space_count;
+
+  int mode;
+  bool escaped;
+  char last_char;
+
+  string buffer;
+  string error;
+
+  // The token being read, if it lies entirely within the current source and
+  // hasn't been rewritten -- otherwise it's in buffer.
+  const char *view;
+  size_t view_length;
+
+  // Offset of the current source in the document.
+  size_t offset;
+  // With lazy positions, pos.line is the number of lines counted up to
+  // counted in the current source, and line_start is where the last of them
+  // started. Lines are only counted a block at a time, when a source is
+  // finished, or when an error needs its position, and until then openings
+  // have only their offsets.
+  size_t line_start;
+  const char *counted;
+
+  position_stack_t openings;
+
+
+  // Sends the current token to the handler, starting at start, and resets it.
+  template <bool TRIM, typename Handler>
+  void send_token(source_kind_t kind, Handler &handler);
+  // Sends a string to the handler.
+  template <typename Handler>
+  void send_string(source_kind_t kind, const char *str, size_t length,
+                   position_t at, Handler &handler);
+  // Returns the position of at in the current source, which begins at source,
+  // to pass to a handler. With lazy positions, only the offset is set.
+  template <bool LAZY>
+  position_t token_position(const char *source, const char *at) const;
+  // Sets pos to the full position of at in the current source and returns
+  // it. With lazy positions, this counts lines up to at, so it's only used
+  // where a full position is needed.
+  template <bool LAZY>
+  const position_t &update_position(const char *source, const char *at);
+  // Sets pos to the full position of at in the current source, and with lazy
+  // positions, also finds the full positions of any openings before it.
+  template <bool LAZY>
+  void count_lines(const char *source, const char *at);
+  // Updates the position and offset once the current source has been read up
+  // to at.
+  template <bool LAZY>
+  void finish_source(const char *source, const char *at);
+  // Advances the position past [from, to), which directly follows the source
+  // last parsed, without parsing it. Only valid between sources.
+  void skip_source(const char *from, const char *to);
+  // Appends a character to the current token. at is where c is in the
+  // source, or null if c isn't in the source as-is (i.e., it was escaped).
+  template <bool TRIM>
+  void buffer_char(const char *at, char c);
+  // Appends a run of length characters from the source, none of which are
+  // spaces, to the current token.
+  void buffer_run(const char *at, size_t length);
+  // Copies the view, if any, into the buffer.
+  void spill_view();
+  // Sends an error to the handler and closes the parser.
+  template <typename Handler>
+  void close_with_error(const string &error, Handler &handler);
+
+  // Formats an error message with the current position.
+  string error_at_pos(const char *message) const;
+  // Formats the error for a document ending with unclosed nodes.
+  string unclosed_error() const;
+};
+/** @endcond */
+
+
+
+/**
+  @brief A Sparse parser with a statically bound handler and options.
+
+  Parses the same way as parser_t, but the handler is called directly rather
+  than through a std::function and the option flags are template arguments,
+  so the compiler can inline the handler and drop any code for disabled
+  options.
+
+  The handler must be callable as
+
+      handler(source_kind_t kind, const char *str, size_t length, position_t pos)
+
+  and receives views as described for view_func_t.
+
+  @tparam Handler The handler type. May be a lambda or any function object.
+  @tparam Options A combination of option_flags_t.
+*/
+template <typename Handler, int Options = SP_DEFAULT_OPTIONS>
+struct basic_parser
+{
+  /** Constructs a parser with the given handler. */
+  explicit basic_parser(Handler handler = Handler());
+
+  /** @see parser_t::add_source(const string &) */
+  void add_source(const string &source);
+  /** @see parser_t::add_source(const char *, size_t) */
+  void add_source(const char *source, size_t length);
+  /** @see parser_t::close() */
+  void close();
+
+  /** @see parser_t::reset() */
+  void reset();
+
+  /** Returns whether the parser encountered an error. */
+  inline bool have_error() const { return !state_.error.empty(); }
+  /** Returns the error string for the parser. */
+  inline const string &error() const { return state_.error; }
+  /** Returns whether the parser is still open. */
+  inline bool is_open() const { return !state_.closed; }
+
+  /** Returns the parser's handler. */
+  inline Handler &handler() { return handler_; }
+  inline const Handler &handler() const { return handler_; }
+
+private:
+  parse_state_t state_;
+  Handler handler_;
+};
+
+
+/** @cond IGNORE */
+// The parsing loop for basic_parser, parser_t, and reader_t. If Pausable, the
+// loop stops before any character at which handler.paused() returns true.
+// Returns the number of bytes consumed, which is all of them unless paused.
+template <int Options, bool Pausable = false, typename Handler>
+size_t parse_source(parse_state_t &state, Handler &handler, const char *source,
+                    size_t length);
+
+template <typename Handler>
+void parse_close(parse_state_t &state, Handler &handler);
+/** @endcond */
+
+
+
+/**
+  @brief The Sparse parser class.
+
+  A parser whose options are chosen at runtime and whose callback is held in a
+  std::function. For a parser that's faster where the options and handler are
+  known at compile time, see basic_parser.
+*/
 struct S_EXPORT parser_t
 {
   /** Constructor. Takes parsing flags and a callback function. */
   parser_t(int options, parse_func_t callback);
+  /** Constructor. Takes parsing flags and a view callback function. */
+  parser_t(int options, view_func_t callback);
   /** Copy constructor. */
   parser_t(const parser_t &other); // Copies parser state, callback, and options
   virtual ~parser_t();
@@ -122,6 +394,11 @@ struct S_EXPORT parser_t
     @param source The source to parse.
   */
   virtual void add_source(const string &source);
+  /**
+    Adds length bytes of source to the parser.
+    @see add_source(const string &)
+  */
+  virtual void add_source(const char *source, size_t length);
   /**
     Closes the parser, signalling that it end close any in-progress elements
     and send the SP_DONE message to the callback.
@@ -129,6 +406,13 @@ struct S_EXPORT parser_t
     If close() is not called, some data may not be fully parsed.
   */
   virtual void close();
+  /**
+    Returns the parser to its initial state, discarding any source not yet
+    closed, so it can parse another document. The parser keeps its callback,
+    options, and any storage it has allocated, so parsing many documents with
+    one parser doesn't allocate once its storage has grown to fit them.
+  */
+  virtual void reset();
 
   /** Returns whether the parser encountered an error. */
   inline virtual bool have_error() const { return !state_.error.empty(); }
@@ -142,61 +426,188 @@ struct S_EXPORT parser_t
 
 
 private:
-  using position_stack_t = std::stack<position_t>;
-
-
-  enum parse_mode_t : int
+  // Adapts parser_t's callbacks to the basic_parser handler interface.
+  struct S_HIDDEN handler_t
   {
-    FIND_NAME    = 0x1 << 0,
-    FIND_VALUE   = 0x1 << 1,
-    READ_NAME    = 0x1 << 2,
-    READ_VALUE   = 0x1 << 3,
-    READ_COMMENT = 0x1 << 4,
+    parser_t *parser;
+    void operator () (source_kind_t kind, const char *str, size_t length, position_t pos);
   };
 
+  using source_func_t = void (*)(parse_state_t &, handler_t &, const char *, size_t);
 
-  struct S_HIDDEN options_t {
-    bool consume_ws;
-    bool trim_spaces;
-    bool nameless_roots;
-    bool nameless_nodes;
-  };
+  // Instantiations of parse_source for each combination of options.
+  template <int Options>
+  static void parse_with(parse_state_t &state, handler_t &handler,
+                         const char *source, size_t length);
+
+
+  int options_;
+  parse_state_t state_;
+  parse_func_t func_;
+  view_func_t view_func_;
+  // Holds tokens passed to func_, which needs a string.
+  string token_;
+};
+
+
+/**
+  Parses the file at path, calling handler for each element as parser_t
+  would. The file is memory-mapped and parsed in place, so elements are passed
+  as views into the mapping wherever possible rather than copied.
+
+  If the file can't be opened, the handler receives a single SP_ERROR
+  describing why, at position 0:0.
+
+  @return Whether the file was opened and parsed without error.
+*/
+S_EXPORT bool parse_file(const char *path, int options, view_func_t handler);
+/** @see parse_file(const char *, int, view_func_t) */
+S_EXPORT bool parse_file(const char *path, int options, parse_func_t handler);
+/**
+  Parses the file at path with a statically bound handler, as basic_parser
+  would.
+  @see parse_file(const char *, int, view_func_t)
+*/
+template <int Options = SP_DEFAULT_OPTIONS, typename Handler>
+bool parse_file(const char *path, Handler &handler);
 
 
-  struct S_EXPORT state_t {
 
-    bool closed;
-    position_t pos;
-    position_t start;
+/**
+  A token read from a reader_t. Holds the same values a view_func_t receives,
+  and str is valid until the next call to reader_t::next() (or until the
+  source it points into is freed, whichever comes first).
+*/
+struct S_EXPORT token_t
+{
+  /** The kind of element read. */
+  source_kind_t kind;
+  /** The start of the element's text. Not NUL-terminated. */
+  const char *str;
+  /** The length of the element's text. */
+  size_t length;
+  /** Where the element was encountered. */
+  position_t pos;
+};
 
-    size_t space_count;
 
-    int mode;
-    bool escaped;
-    char last_char;
 
-    parse_func_t func;
+/**
+  @brief A pull-based Sparse parser.
+
+  Rather than passing each element to a callback, a reader_t parses only as
+  far as needed to return the next token from next(). Reading can stop at any
+  point, e.g. after a document's header node, without parsing the rest of the
+  source, and skip_node() skips the remainder of a node.
+
+  Source may be given all at once or in chunks. Sources are not copied, so
+  each must remain valid until next() returns false for want of more source.
+  Tokens point into the source where possible, as with view_func_t.
+
+      reader_t reader(source.data(), source.size());
+      token_t token;
+      while (reader.next(token)) {
+        ...
+      }
+*/
+struct S_EXPORT reader_t
+{
+  /** Constructs a reader to be given source with add_source(). */
+  explicit reader_t(int options = SP_DEFAULT_OPTIONS);
+  /**
+    Constructs a reader over a complete document. Equivalent to calling
+    add_source() and close().
+  */
+  reader_t(const char *source, size_t length, int options = SP_DEFAULT_OPTIONS);
+
+  reader_t(const reader_t &) = delete;
+  reader_t &operator = (const reader_t &) = delete;
+
+  /**
+    Adds length bytes of source to the reader. Throws std::logic_error if the
+    previous source has not been read yet or the reader has been closed.
+  */
+  void add_source(const char *source, size_t length);
+  /** @see add_source(const char *, size_t) */
+  void add_source(const string &source);
+  /**
+    Signals that there is no more source. Once the remaining source is read,
+    next() returns any final tokens followed by SP_DONE (or SP_ERROR).
+  */
+  void close();
+  /**
+    Returns the reader to its initial state, discarding any unread tokens, so
+    it can read another document. Keeps its options and any storage it has
+    allocated.
+  */
+  void reset();
+
+  /**
+    Reads the next token. Returns false if there are no more tokens, either
+    because the reader needs more source or because it has finished, in which
+    case token is unchanged.
+  */
+  bool next(token_t &token);
+
+  /**
+    Skips the rest of the innermost open node. Subsequent calls to next()
+    discard tokens up to and including the node's SP_CLOSE_NODE. SP_ERROR and
+    SP_DONE tokens are never skipped. Throws std::logic_error if no node is
+    open.
+  */
+  void skip_node();
 
-    string buffer;
-    string error;
+  /** Returns the number of nodes opened by tokens read so far. */
+  inline size_t depth() const { return depth_; }
+  /**
+    Returns whether the reader needs more source before it can read another
+    token. Always false once closed.
+  */
+  inline bool needs_source() const { return !closing_ && source_ == source_end_ && read_ == count_; }
+  /** Returns whether the reader has read its last token. */
+  inline bool at_end() const { return state_.closed && read_ == count_; }
+  /** Returns whether the reader encountered an error. */
+  inline bool have_error() const { return !state_.error.empty(); }
+  /** Returns the error string for the reader. */
+  inline const string &error() const { return state_.error; }
 
-    position_stack_t openings;
+private:
+  // The most tokens parsing a single character (or closing) can produce.
+  static const size_t MAX_PENDING_TOKENS = 4;
 
-    // Note: source may be a reference to state_.buffer.
-    S_HIDDEN void send_buffer_and_reset(source_kind_t kind, const options_t &options);
-    S_HIDDEN void send_string(source_kind_t kind, const string &source);
-    S_HIDDEN void buffer_char(char c, const options_t &options);
-    S_EXPORT void close_with_error(const string &error);
-    // Copies the buffer after resizing it
-    S_HIDDEN const string &trimmed_buffer(const options_t &options);
+  // Queues tokens for next() and pauses parsing while any are queued.
+  struct S_HIDDEN handler_t
+  {
+    reader_t *reader;
+    void operator () (source_kind_t kind, const char *str, size_t length, position_t pos);
+    inline bool paused() const { return reader->count_ > 0; }
   };
 
+  using source_func_t = size_t (*)(parse_state_t &, handler_t &, const char *, size_t);
 
-  options_t options_;
-  state_t state_;
+  template <int Options>
+  static size_t parse_with(parse_state_t &state, handler_t &handler,
+                           const char *source, size_t length);
 
+  // Parses until at least one token is queued or the source runs out.
+  void fill();
 
-  static const state_t DEFAULT_STATE;
+
+  source_func_t parse_;
+  parse_state_t state_;
+  const char *source_;
+  const char *source_end_;
+  bool closing_;
+  size_t depth_;
+  // Depth at which skipping ends, if skipping.
+  bool skipping_;
+  size_t skip_depth_;
+
+  size_t read_;
+  size_t count_;
+  token_t pending_[MAX_PENDING_TOKENS];
+  // Copies of tokens that weren't views into the source.
+  string text_[MAX_PENDING_TOKENS];
 };
 
 
@@ -207,3 +618,5 @@ private:
 
 
 } // namespace snow
+
+#include "inline/sparse.hh"
@@ -0,0 +1,389 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#pragma once
+
+#include <snow/config.hh>
+#include <snow/data/sparse.hh>
+#include <snow/data/sparse_value.hh>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+
+namespace snow {
+
+
+/** @addtogroup Sparse Sparse
+  @{
+*/
+
+
+namespace sparse {
+
+
+/**
+  Reads values of type T for schema fields, with read_value by default. For
+  other field types, either overload read_value in the type's namespace or
+  specialize this, providing the same operator () as below.
+*/
+template <typename T, typename Enable = void>
+struct value_reader_t
+{
+  bool operator () (const char *str, size_t length, T &out) const
+  {
+    return read_value(str, length, out);
+  }
+};
+
+
+template <>
+struct value_reader_t<string>
+{
+  bool operator () (const char *str, size_t length, string &out) const
+  {
+    out.assign(str, string::size_type(length));
+    return true;
+  }
+};
+
+
+template <>
+struct value_reader_t<std::string>
+{
+  bool operator () (const char *str, size_t length, std::string &out) const
+  {
+    out.assign(str, length);
+    return true;
+  }
+};
+
+
+
+/**
+  @brief The untyped part of a schema_t.
+
+  Holds a schema's entries and the table used to look them up by name. The
+  table is open-addressed by the entries' mixed name hashes and kept at most
+  half full, so a lookup costs one hash and, on average, little more than one
+  comparison regardless of how many entries there are.
+*/
+struct S_EXPORT schema_base_t
+{
+  /** The kinds of schema entries. */
+  enum entry_kind_t : int
+  {
+    /** A value, converted and stored in a field. */
+    FIELD,
+    /** A node, whose children are bound to a member object. */
+    NODE,
+    /** A node that may repeat, each appended to a member vector. */
+    NODES,
+  };
+
+  /** @cond IGNORE */
+  // Enough space for a pointer to a data member
+  static const size_t MEMBER_SIZE = 2 * sizeof(void *);
+
+  struct entry_t
+  {
+    using assign_func_t = bool (*)(const void *member, void *object,
+                                   const char *str, size_t length);
+    using enter_func_t = void *(*)(const void *member, void *object);
+
+    string               name;
+    entry_kind_t         kind;
+    // A copy of the member pointer, passed to assign or enter.
+    unsigned char        member[MEMBER_SIZE];
+    assign_func_t        assign;
+    enter_func_t         enter;
+    // The schema of a NODE or NODES entry's children.
+    const schema_base_t *schema;
+    // The hash of name, set by add.
+    uint64_t             hash;
+  };
+  /** @endcond */
+
+
+  /** Returns the number of entries in the schema. */
+  inline size_t size() const { return entries_.size(); }
+
+  /** @cond IGNORE */
+  // Returns the entry with the given name, or null if there is none.
+  const entry_t *find(const char *name, size_t length) const;
+  /** @endcond */
+
+protected:
+  schema_base_t();
+
+  // Adds an entry to the schema and its table. Throws std::invalid_argument
+  // if the schema already has an entry by that name.
+  void add(entry_t entry);
+
+private:
+  // Returns the entry with the given name and hash, or null.
+  const entry_t *find_hashed(const char *name, size_t length, uint64_t hash) const;
+  // Puts an entry in the first free slot for its hash.
+  void insert_slot(uint32_t index);
+  // Rebuilds the table with the given number of slots, a power of two.
+  void build_table(size_t size);
+
+
+  std::vector<entry_t>  entries_;
+  // Entry indices, probed linearly from their hash, or NO_ENTRY.
+  std::vector<uint32_t> slots_;
+  size_t                mask_;
+};
+
+
+
+/**
+  @brief Describes how a Sparse document binds to a struct.
+
+  Each field and nested node is registered once, by name. When a document is
+  bound with binder_t, each value is converted with value_reader_t and stored
+  straight into the matching field, and each nested node is bound to its
+  member using that member's schema.
+
+      struct transform_t { float x, y, z; };
+      struct entity_t { std::string name; int health; transform_t transform; };
+
+      schema_t<transform_t> transform;
+      transform.field("x", &transform_t::x)
+               .field("y", &transform_t::y)
+               .field("z", &transform_t::z);
+      schema_t<entity_t> entity;
+      entity.field("name", &entity_t::name)
+            .field("health", &entity_t::health)
+            .node("transform", &entity_t::transform, transform);
+
+  Schemas hold pointers to the schemas of their nodes, so those must outlive
+  them.
+*/
+template <typename T>
+struct schema_t : schema_base_t
+{
+  /** Binds values named name to member. */
+  template <typename M>
+  schema_t &field(const char *name, M T::*member);
+
+  /** Binds the children of nodes named name to member using schema. */
+  template <typename U>
+  schema_t &node(const char *name, U T::*member, const schema_t<U> &schema);
+
+  /**
+    Binds the children of each node named name to a new element appended to
+    member, using schema.
+  */
+  template <typename U>
+  schema_t &nodes(const char *name, std::vector<U> T::*member,
+                  const schema_t<U> &schema);
+
+private:
+  template <typename M>
+  static bool assign_member(const void *member, void *object, const char *str,
+                            size_t length);
+  template <typename U>
+  static void *enter_member(const void *member, void *object);
+  template <typename U>
+  static void *enter_element(const void *member, void *object);
+
+  template <typename P>
+  static entry_t make_entry(const char *name, entry_kind_t kind, P member);
+};
+
+
+
+/**
+  @brief Binds Sparse documents to structs described by a schema_t.
+
+  Names without an entry in the schema are skipped, along with any children.
+  If a value can't be converted to its field's type, or a name is used as a
+  value where its schema expects a node or vice versa, binding carries on but
+  reports the first such error.
+
+      entity_t entity;
+      binder_t binder(entity_schema, entity);
+      if (!binder.parse(source.data(), source.size())) {
+        s_log_error("%s", binder.error().c_str());
+      }
+
+  binder_t can also be used as the handler of a basic_parser.
+*/
+struct S_EXPORT binder_t
+{
+  /** Constructs a binder that binds to target using schema. */
+  template <typename T>
+  binder_t(const schema_t<T> &schema, T &target);
+
+  /**
+    Parses a complete document, binding it to the target. Returns false if the
+    document is invalid or couldn't be bound, in which case error() says why.
+  */
+  bool parse(const char *source, size_t length, int options = SP_DEFAULT_OPTIONS);
+  /** @see parse(const char *, size_t, int) */
+  bool parse(const string &source, int options = SP_DEFAULT_OPTIONS);
+  /**
+    Parses the file at path, binding it to the target.
+    @see parse(const char *, size_t, int)
+  */
+  bool parse_file(const char *path, int options = SP_DEFAULT_OPTIONS);
+
+  /** Returns whether parsing or binding failed. */
+  inline bool have_error() const { return !error_.empty(); }
+  /** Returns the first error encountered, if any. */
+  inline const string &error() const { return error_; }
+
+  /** Receives elements from a parser. */
+  void operator () (source_kind_t kind, const char *str, size_t length, position_t pos);
+
+private:
+  // An open node and what its children bind to. Both are null for nodes being
+  // skipped.
+  struct frame_t
+  {
+    void                *object;
+    const schema_base_t *schema;
+  };
+
+  using parse_func_t = void (*)(binder_t &, const char *, size_t);
+
+  template <int Options>
+  static void parse_with(binder_t &binder, const char *source, size_t length);
+
+  // Records an error for the entry named at pos unless one was already
+  // recorded.
+  void entry_error(const char *message);
+
+
+  std::vector<frame_t>           frames_;
+  // The root frame, restored when parsing begins.
+  frame_t                        root_;
+  // The entry named by the last SP_NAME, if any.
+  const schema_base_t::entry_t  *entry_;
+  position_t                     name_pos_;
+  string                         error_;
+};
+
+
+
+template <typename T>
+template <typename M>
+schema_t<T> &schema_t<T>::field(const char *name, M T::*member)
+{
+  entry_t entry = make_entry(name, FIELD, member);
+  entry.assign = &assign_member<M>;
+  add(std::move(entry));
+  return *this;
+}
+
+
+
+template <typename T>
+template <typename U>
+schema_t<T> &schema_t<T>::node(const char *name, U T::*member,
+                               const schema_t<U> &schema)
+{
+  entry_t entry = make_entry(name, NODE, member);
+  entry.enter = &enter_member<U>;
+  entry.schema = &schema;
+  add(std::move(entry));
+  return *this;
+}
+
+
+
+template <typename T>
+template <typename U>
+schema_t<T> &schema_t<T>::nodes(const char *name, std::vector<U> T::*member,
+                                const schema_t<U> &schema)
+{
+  entry_t entry = make_entry(name, NODES, member);
+  entry.enter = &enter_element<U>;
+  entry.schema = &schema;
+  add(std::move(entry));
+  return *this;
+}
+
+
+
+template <typename T>
+template <typename M>
+bool schema_t<T>::assign_member(const void *member, void *object,
+                                const char *str, size_t length)
+{
+  M T::*field;
+  std::memcpy(&field, member, sizeof(field));
+  return value_reader_t<M>()(str, length, static_cast<T *>(object)->*field);
+}
+
+
+
+template <typename T>
+template <typename U>
+void *schema_t<T>::enter_member(const void *member, void *object)
+{
+  U T::*field;
+  std::memcpy(&field, member, sizeof(field));
+  return &(static_cast<T *>(object)->*field);
+}
+
+
+
+template <typename T>
+template <typename U>
+void *schema_t<T>::enter_element(const void *member, void *object)
+{
+  std::vector<U> T::*field;
+  std::memcpy(&field, member, sizeof(field));
+  std::vector<U> &elements = static_cast<T *>(object)->*field;
+  elements.emplace_back();
+  return &elements.back();
+}
+
+
+
+template <typename T>
+template <typename P>
+typename schema_t<T>::entry_t schema_t<T>::make_entry(const char *name,
+                                                      entry_kind_t kind,
+                                                      P member)
+{
+  static_assert(sizeof(member) <= MEMBER_SIZE,
+                "Member pointer is too large for a schema entry");
+  entry_t entry;
+  entry.name = name;
+  entry.kind = kind;
+  std::memcpy(entry.member, &member, sizeof(member));
+  entry.assign = nullptr;
+  entry.enter = nullptr;
+  entry.schema = nullptr;
+  return entry;
+}
+
+
+
+template <typename T>
+binder_t::binder_t(const schema_t<T> &schema, T &target) :
+  root_ { &target, &schema },
+  entry_(nullptr),
+  name_pos_ { 0, 0, 0 }
+{
+  frames_.push_back(root_);
+}
+
+
+} // namespace sparse
+
+
+/** @} */
+
+
+} // namespace snow
@@ -0,0 +1,516 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#pragma once
+
+#include <snow/config.hh>
+#include <snow/data/buffer_stream.hh>
+#include <snow/data/mapped_file.hh>
+#include <snow/data/sparse.hh>
+#include <snow/data/sparse_value.hh>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+
+namespace snow {
+
+
+/** @addtogroup Sparse Sparse
+  @{
+*/
+
+
+namespace sparse {
+
+
+/**
+  @brief A parsed Sparse document.
+
+  Nodes are kept in a single array and refer to one another by index, and all
+  names and values are kept in a single text arena, so a document costs a
+  handful of allocations regardless of its size. Reusing a document_t for
+  another parse reuses its storage.
+
+  Node 0 is the root, a nameless node whose children are the document's
+  top-level nodes. Every other node has a name and either a value or children
+  (possibly none, as in `name {}`). Names and values in the arena are
+  NUL-terminated.
+
+      document_t doc;
+      if (doc.parse(source)) {
+        document_t::index_t size = doc.find("render/shadows/size");
+        if (size != document_t::NO_NODE && !doc.is_branch(size))
+          use(doc.value(size));
+      }
+*/
+struct S_EXPORT document_t
+{
+  using index_t = uint32_t;
+
+  /** Index used for a missing node. */
+  static const index_t NO_NODE = UINT32_MAX;
+  /** Index of the root node. */
+  static const index_t ROOT = 0;
+
+
+  /** A node in the document. */
+  struct node_t
+  {
+    index_t    parent;
+    index_t    first_child;
+    index_t    next_sibling;
+    /** Whether the node was opened with '{'. */
+    bool       branch;
+    /** Offsets and lengths of the node's name and value in the text arena. */
+    size_t     name_offset;
+    size_t     name_length;
+    size_t     value_offset;
+    size_t     value_length;
+    /** Where the node's name was encountered. */
+    position_t pos;
+  };
+
+  /** A node added, removed, or modified by reparse(). */
+  struct change_t
+  {
+    enum kind_t : int
+    {
+      ADDED,
+      REMOVED,
+      /** A leaf's value changed, or a node changed between leaf and branch. */
+      MODIFIED,
+    };
+
+    kind_t  kind;
+    /** The '/'-separated names of the node and its ancestors. */
+    string  path;
+    /** The node's index in the updated document, or NO_NODE if removed. */
+    index_t node;
+  };
+
+
+  /** Constructs an empty document, containing only the root. */
+  document_t();
+
+  /**
+    Parses a complete document, replacing the document's contents. Returns
+    false if the source is invalid, in which case the document is left empty
+    and error() describes the problem.
+  */
+  bool parse(const char *source, size_t length, int options = SP_DEFAULT_OPTIONS);
+  /** @see parse(const char *, size_t, int) */
+  bool parse(const string &source, int options = SP_DEFAULT_OPTIONS);
+
+  /**
+    Parses a complete document as parse() does, but splits the source between
+    top-level nodes and parses the parts on up to thread_count threads (or one
+    per hardware thread, if zero). The resulting document, including node
+    positions and any error, is the same as parse() would produce.
+
+    Sources under a few hundred KB, or without enough top-level nodes to
+    split between, are parsed on the calling thread.
+  */
+  bool parse_parallel(const char *source, size_t length,
+                      int options = SP_DEFAULT_OPTIONS, unsigned thread_count = 0);
+
+  /**
+    Updates the document after an edit to the source it was parsed from,
+    re-parsing only the top-level nodes the edit touches. source is the whole
+    edited source, in which the edit replaced removed_length bytes at
+    edit_offset with inserted_length bytes. The document must have been parsed
+    from the source as it was before the edit, with the same options.
+
+    The nodes added, removed, and modified by the edit are stored in changes,
+    grouped by parent. Descendants of added and removed branches aren't listed
+    separately. Where siblings share a name, they're matched in order.
+
+    If the edit changes the source's structure beyond the nodes it touches,
+    e.g. by opening a node that's closed further on, the whole source is
+    re-parsed. Returns false if the edited source isn't valid, in which case
+    the document is left empty, as by parse().
+  */
+  bool reparse(const char *source, size_t length, size_t edit_offset,
+               size_t removed_length, size_t inserted_length,
+               std::vector<change_t> &changes, int options = SP_DEFAULT_OPTIONS);
+
+  /**
+    Parses the file at path, replacing the document's contents. The file is
+    memory-mapped rather than read into memory first. Returns false if the
+    file can't be opened or isn't valid, in which case the document is left
+    empty and error() describes the problem.
+  */
+  bool parse_file(const char *path, int options = SP_DEFAULT_OPTIONS);
+
+  /**
+    Parses only the nodes of source at a '/'-separated path of names, as for
+    find(), along with their children. The selected nodes become the
+    document's top-level nodes, in the order they appear, and keep their
+    positions in source. A name of "*" in the path matches any name, e.g. to
+    select the transform node of every child of entities.
+
+    Branches off the path are skipped by matching braces, without parsing
+    them, so a selection costs little more than a scan of the source. Errors
+    inside skipped branches go undetected, apart from unbalanced braces.
+    Returns false if the source is invalid, in which case the document is left
+    empty, as by parse().
+  */
+  bool select(const char *source, size_t length, const char *path,
+              size_t path_length, int options = SP_DEFAULT_OPTIONS);
+  /** @see select(const char *, size_t, const char *, size_t, int) */
+  bool select(const string &source, const char *path,
+              int options = SP_DEFAULT_OPTIONS);
+  /**
+    Selects nodes from the file at path, as select() does, memory-mapping the
+    file rather than reading it into memory first.
+    @see select(const char *, size_t, const char *, size_t, int)
+  */
+  bool select_file(const char *file_path, const char *path,
+                   int options = SP_DEFAULT_OPTIONS);
+
+  /**
+    Returns the number of bytes needed to compile the document to a binary
+    image, or zero if the document is too large to compile (its text must be
+    under 4 GB).
+  */
+  size_t compiled_size() const;
+  /**
+    Writes the document to the stream as a binary image that can be loaded by
+    compiled_document_t. Returns the number of bytes written, or zero if the
+    stream is too small or the document can't be compiled, in which case
+    nothing is written.
+  */
+  size_t compile(buffer_stream_t &out) const;
+  /**
+    Writes the document's binary image to the file at path, replacing it.
+    Returns false if the document can't be compiled or written.
+  */
+  bool compile_file(const char *path) const;
+
+  /** Removes all nodes but the root. Keeps any allocated storage. */
+  void clear();
+
+  /** Returns whether the last parse failed. */
+  inline bool have_error() const { return !error_.empty(); }
+  /** Returns the error from the last parse, if any. */
+  inline const string &error() const { return error_; }
+
+  /** Returns the number of nodes in the document, including the root. */
+  inline size_t size() const { return nodes_.size(); }
+
+  /** Returns the node at the given index. */
+  inline const node_t &node(index_t index) const { return nodes_[index]; }
+  inline const node_t &operator [] (index_t index) const { return nodes_[index]; }
+
+  inline index_t parent(index_t index) const { return nodes_[index].parent; }
+  inline index_t first_child(index_t index) const { return nodes_[index].first_child; }
+  inline index_t next_sibling(index_t index) const { return nodes_[index].next_sibling; }
+  inline bool is_branch(index_t index) const { return nodes_[index].branch; }
+
+  /** Returns a node's name. */
+  inline const char *name(index_t index) const { return &text_[nodes_[index].name_offset]; }
+  inline size_t name_length(index_t index) const { return nodes_[index].name_length; }
+  /** Returns a node's value. Empty for branches. */
+  inline const char *value(index_t index) const { return &text_[nodes_[index].value_offset]; }
+  inline size_t value_length(index_t index) const { return nodes_[index].value_length; }
+  /**
+    Reads a node's value as a T, e.g. a number or vector, with read_value.
+    Returns false if the value isn't a valid T.
+  */
+  template <typename T>
+  inline bool read_value(index_t index, T &out) const
+  {
+    return sparse::read_value(value(index), value_length(index), out);
+  }
+  /** Returns where a node's name was in the source. */
+  inline position_t position(index_t index) const { return nodes_[index].pos; }
+
+  /**
+    Returns the first child of parent with the given name, or NO_NODE if
+    there is none.
+
+    Each node's children are indexed by name as the document is parsed,
+    selected, or reparsed, so this costs one hash of the name regardless of
+    how many children parent has.
+  */
+  index_t find_child(index_t parent, const char *name, size_t length) const;
+
+  /**
+    Finds a node by a '/'-separated path of names relative to the node from,
+    e.g. "render/shadows/size". Where siblings share a name, the first is
+    followed. Returns NO_NODE if there is no such node.
+
+    Each name is found as by find_child(), so a lookup costs O(depth).
+  */
+  index_t find(const char *path, size_t length, index_t from = ROOT) const;
+  /** @see find(const char *, size_t, index_t) */
+  index_t find(const string &path, index_t from = ROOT) const;
+  /** @see find(const char *, size_t, index_t) */
+  index_t find(const char *path, index_t from = ROOT) const;
+
+  /** @cond IGNORE */
+  // A part of a source that begins outside of any node, for parse_parallel.
+  struct part_t
+  {
+    const char *source;
+    size_t      length;
+    position_t  start;
+  };
+
+  // A slot in the name index: a child, or NO_NODE if the slot is free, and
+  // the low bits of its name's hash.
+  struct name_slot_t
+  {
+    index_t  node;
+    uint32_t hash;
+  };
+  /** @endcond */
+
+private:
+  // Builds the document from parser tokens.
+  struct S_HIDDEN builder_t
+  {
+    document_t *doc;
+    void operator () (source_kind_t kind, const char *str, size_t length, position_t pos);
+  };
+
+  // Passes the nodes at a path, and their children, on to a builder_t.
+  // Pauses the parser at any other branch, for select_with to skip.
+  struct S_HIDDEN selector_t
+  {
+    using segment_t = std::pair<const char *, size_t>;
+
+    builder_t                     builder;
+    const std::vector<segment_t> *path;
+    // Depth of the innermost open node.
+    size_t                        depth;
+    // Whether the last name at a depth on the path matched it.
+    bool                          matched;
+    bool                          skipping;
+
+    void operator () (source_kind_t kind, const char *str, size_t length, position_t pos);
+    inline bool paused() const { return skipping; }
+  };
+
+  // Where parsing a part of a source stopped.
+  struct S_HIDDEN part_end_t
+  {
+    position_t pos;
+    // Whether the part ended outside of any node and not reading anything.
+    bool       between_nodes;
+  };
+
+  using build_func_t = void (*)(document_t &, const char *, size_t, position_t,
+                                bool, part_end_t *);
+
+  using select_func_t = void (*)(selector_t &, const char *, size_t);
+
+  template <int Options>
+  static void select_with(selector_t &selector, const char *source, size_t length);
+
+  template <int Options>
+  static void build_with(document_t &doc, const char *source, size_t length,
+                         position_t start, bool last, part_end_t *end);
+
+  // Parses part of a source into the document, starting at start. Only the
+  // last part of a source is closed. If end isn't null, it's set to where
+  // parsing stopped.
+  bool parse_part(const char *source, size_t length, int options,
+                  position_t start, bool last, part_end_t *end = nullptr);
+  // Replaces the top-level nodes [first, last] of tops with the nodes of part.
+  void splice_part(const std::vector<index_t> &tops, size_t first, size_t last,
+                   const document_t &part, const part_end_t &end,
+                   size_t offset_delta);
+  // Rewrites the text arena without the text of removed nodes.
+  void compact_text();
+  // Appends the nodes of documents parsed from consecutive parts of a source.
+  void merge_parts(const std::vector<document_t> &docs);
+  // Rebuilds the name index from the nodes. Called once the nodes of a parse
+  // or select are complete.
+  void index_names();
+  // Rebuilds the root's name table, e.g. after merging or splicing in parts
+  // whose tables are already built.
+  void index_top_level();
+  // Adds a node to its parent's name table, unless an earlier sibling has the
+  // same name.
+  void index_child(index_t child);
+  // Returns the slot in parent's name table holding the given name, or the
+  // free slot where it would go.
+  name_slot_t *find_name_slot(index_t parent, const char *name, size_t length,
+                              uint32_t hash);
+  // Frees a slot in parent's name table, moving back any entries after it
+  // that would otherwise no longer be found.
+  void remove_name_slot(index_t parent, name_slot_t *slot);
+
+  // Appends text to the arena, NUL-terminated, and returns its offset.
+  size_t add_text(const char *str, size_t length);
+
+
+  std::vector<node_t> nodes_;
+  // All names and values, each followed by a NUL. Starts with an empty
+  // string shared by the root's name and branches' values.
+  std::vector<char>   text_;
+  // Bytes of text_ left unused by nodes replaced by reparse().
+  size_t              dead_text_;
+  // The name index: a table per node of its children, probed linearly from
+  // the hashes of their names. Node i's table is names_[name_tables_[i]] up to
+  // names_[name_tables_[i + 1]], and is either empty or a power of two in size
+  // and at most half full. Only the first of any siblings sharing a name is
+  // in a table.
+  std::vector<size_t>      name_tables_;
+  std::vector<name_slot_t> names_;
+  string              error_;
+
+  // Build state -- the open branches, and the last node added to each of
+  // them, innermost last.
+  std::vector<index_t> open_;
+  std::vector<index_t> last_child_;
+};
+
+
+
+
+/**
+  @brief A Sparse document loaded from a binary image.
+
+  Images are written by document_t::compile and loaded without parsing: the
+  loader checks the image's header and then reads nodes, the name index, and
+  text directly out of the image, so a memory-mapped image is only paged in
+  as it's navigated. Navigation is the same as for document_t.
+
+  Images are in host byte order and are only loadable on hosts of the same
+  endianness. Only the header and overall size of an image are checked when
+  loading -- use verify() before navigating an image from an untrusted source.
+*/
+struct S_EXPORT compiled_document_t
+{
+  using index_t = document_t::index_t;
+
+  static const index_t NO_NODE = document_t::NO_NODE;
+  static const index_t ROOT = document_t::ROOT;
+  /** The image format version written and accepted. */
+  static const uint32_t VERSION = 2;
+
+
+  /** A node as stored in an image. */
+  struct node_t
+  {
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    /** Non-zero if the node is a branch. */
+    uint32_t branch;
+    uint32_t name_offset;
+    uint32_t name_length;
+    uint32_t value_offset;
+    uint32_t value_length;
+    uint32_t line;
+    uint32_t column;
+  };
+
+
+  /** Constructs an empty document, containing only the root. */
+  compiled_document_t();
+
+  compiled_document_t(compiled_document_t &&other);
+  compiled_document_t &operator = (compiled_document_t &&other);
+
+  compiled_document_t(const compiled_document_t &) = delete;
+  compiled_document_t &operator = (const compiled_document_t &) = delete;
+
+  /**
+    Memory-maps the image at path. Returns false if the file can't be opened
+    or doesn't contain an image, in which case the document is left empty and
+    error() says why.
+  */
+  bool load_file(const char *path);
+  /**
+    Uses the image in data, which must remain valid and unchanged until the
+    document is cleared or destroyed. data must be aligned to 4 bytes.
+    @see load_file(const char *)
+  */
+  bool load(const void *data, size_t length);
+
+  /** Empties the document and releases its image. */
+  void clear();
+
+  /**
+    Checks that every node, string, and name index entry in the image is in
+    bounds and that the nodes form a tree. Touches the whole image.
+  */
+  bool verify() const;
+
+  inline bool have_error() const { return !error_.empty(); }
+  inline const string &error() const { return error_; }
+
+  /** @see document_t::size() */
+  inline size_t size() const { return node_count_; }
+
+  inline const node_t &node(index_t index) const { return nodes_[index]; }
+  inline const node_t &operator [] (index_t index) const { return nodes_[index]; }
+
+  inline index_t parent(index_t index) const { return nodes_[index].parent; }
+  inline index_t first_child(index_t index) const { return nodes_[index].first_child; }
+  inline index_t next_sibling(index_t index) const { return nodes_[index].next_sibling; }
+  inline bool is_branch(index_t index) const { return nodes_[index].branch != 0; }
+
+  inline const char *name(index_t index) const { return text_ + nodes_[index].name_offset; }
+  inline size_t name_length(index_t index) const { return nodes_[index].name_length; }
+  inline const char *value(index_t index) const { return text_ + nodes_[index].value_offset; }
+  inline size_t value_length(index_t index) const { return nodes_[index].value_length; }
+  /** @see document_t::read_value(index_t, T &) */
+  template <typename T>
+  inline bool read_value(index_t index, T &out) const
+  {
+    return sparse::read_value(value(index), value_length(index), out);
+  }
+  /**
+    Returns where a node's name was in the source document. Images don't
+    store offsets, so the position's offset is always zero.
+  */
+  inline position_t position(index_t index) const
+  {
+    return position_t { nodes_[index].line, nodes_[index].column, 0 };
+  }
+
+  /**
+    Returns the first child of parent with the given name, or NO_NODE. Uses
+    the image's name index, as document_t does.
+    @see document_t::find_child(index_t, const char *, size_t)
+  */
+  index_t find_child(index_t parent, const char *name, size_t length) const;
+  /**
+    Finds a node by a '/'-separated path of names.
+    @see document_t::find(const char *, size_t, index_t)
+  */
+  index_t find(const char *path, size_t length, index_t from = ROOT) const;
+  index_t find(const string &path, index_t from = ROOT) const;
+  index_t find(const char *path, index_t from = ROOT) const;
+
+private:
+  mapped_file_t   file_;
+  const node_t   *nodes_;
+  size_t          node_count_;
+  // The image's copy of document_t's name index.
+  const uint32_t *name_tables_;
+  const document_t::name_slot_t *names_;
+  size_t          name_slots_;
+  const char     *text_;
+  size_t          text_size_;
+  string          error_;
+};
+
+
+} // namespace sparse
+
+
+/** @} */
+
+
+} // namespace snow
@@ -0,0 +1,194 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#pragma once
+
+#include <snow/config.hh>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+
+namespace snow {
+
+
+/** @cond IGNORE */
+template <typename T> struct vec2_t;
+template <typename T> struct vec3_t;
+template <typename T> struct vec4_t;
+/** @endcond */
+
+
+/** @addtogroup Sparse Sparse
+  @{
+*/
+
+
+namespace sparse {
+
+
+/**
+  Reads a value as a signed integer, in decimal with an optional sign or in
+  hexadecimal with a 0x prefix. Returns false if the value isn't an integer or
+  doesn't fit, in which case out is unchanged.
+
+  Like the other read_value functions, this works on any view of a value --
+  e.g. one passed to a view_func_t or taken from a document_t -- and neither
+  allocates nor depends on the current locale.
+*/
+S_EXPORT bool read_value(const char *str, size_t length, int64_t &out);
+/** Reads a value as an unsigned integer. @see read_value(const char *, size_t, int64_t &) */
+S_EXPORT bool read_value(const char *str, size_t length, uint64_t &out);
+/**
+  Reads a value as a floating point number: a decimal number with an optional
+  sign, fraction, and exponent, or inf, infinity, or nan (ignoring case). The
+  result is the nearest double to the number. Returns false if the value isn't
+  a number or is too large for a double, in which case out is unchanged.
+*/
+S_EXPORT bool read_value(const char *str, size_t length, double &out);
+/**
+  Reads a value as a float, rounded directly to the nearest float rather than
+  by way of a double.
+  @see read_value(const char *, size_t, double &)
+*/
+S_EXPORT bool read_value(const char *str, size_t length, float &out);
+/**
+  Reads a value as a boolean: any of true, yes, or on, or false, no, or off
+  (ignoring case), or 1 or 0. Returns false if the value isn't one of these.
+*/
+S_EXPORT bool read_value(const char *str, size_t length, bool &out);
+
+/**
+  Reads a value as an integer of type T, failing if it doesn't fit in a T.
+  @see read_value(const char *, size_t, int64_t &)
+*/
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, bool>::type
+read_value(const char *str, size_t length, T &out);
+
+/**
+  Reads count numbers separated by whitespace, such as "0.5 1 -2", into out.
+  Each is read as read_value would read it into a T. Returns false unless the
+  value holds exactly count valid numbers, in which case some of out may have
+  been written anyway.
+*/
+template <typename T>
+bool read_tuple(const char *str, size_t length, T *out, size_t count);
+
+/** Reads a vector's components as a tuple. @see read_tuple */
+template <typename T>
+bool read_value(const char *str, size_t length, vec2_t<T> &out);
+/** @see read_value(const char *, size_t, vec2_t<T> &) */
+template <typename T>
+bool read_value(const char *str, size_t length, vec3_t<T> &out);
+/** @see read_value(const char *, size_t, vec2_t<T> &) */
+template <typename T>
+bool read_value(const char *str, size_t length, vec4_t<T> &out);
+
+
+
+template <typename T>
+typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value, bool>::type
+read_value(const char *str, size_t length, T &out)
+{
+  using wide_t = typename std::conditional<std::is_signed<T>::value, int64_t, uint64_t>::type;
+  wide_t value;
+  if (!read_value(str, length, value) ||
+      value < wide_t(std::numeric_limits<T>::min()) ||
+      value > wide_t(std::numeric_limits<T>::max())) {
+    return false;
+  }
+  out = T(value);
+  return true;
+}
+
+
+
+template <typename T>
+bool read_tuple(const char *str, size_t length, T *out, size_t count)
+{
+  const char *const end = str + length;
+  const auto is_space = [](char ch) {
+    return ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r';
+  };
+
+  for (size_t index = 0; index < count; ++index) {
+    while (str < end && is_space(*str)) {
+      ++str;
+    }
+    const char *element_end = str;
+    while (element_end < end && !is_space(*element_end)) {
+      ++element_end;
+    }
+    if (!read_value(str, size_t(element_end - str), out[index])) {
+      return false;
+    }
+    str = element_end;
+  }
+
+  while (str < end && is_space(*str)) {
+    ++str;
+  }
+  return str == end;
+}
+
+
+
+template <typename T>
+bool read_value(const char *str, size_t length, vec2_t<T> &out)
+{
+  T elements[2];
+  if (!read_tuple(str, length, elements, 2)) {
+    return false;
+  }
+  out.x = elements[0];
+  out.y = elements[1];
+  return true;
+}
+
+
+
+template <typename T>
+bool read_value(const char *str, size_t length, vec3_t<T> &out)
+{
+  T elements[3];
+  if (!read_tuple(str, length, elements, 3)) {
+    return false;
+  }
+  out.x = elements[0];
+  out.y = elements[1];
+  out.z = elements[2];
+  return true;
+}
+
+
+
+template <typename T>
+bool read_value(const char *str, size_t length, vec4_t<T> &out)
+{
+  T elements[4];
+  if (!read_tuple(str, length, elements, 4)) {
+    return false;
+  }
+  out.x = elements[0];
+  out.y = elements[1];
+  out.z = elements[2];
+  out.w = elements[3];
+  return true;
+}
+
+
+} // namespace sparse
+
+
+/** @} */
+
+
+} // namespace snow
@@ -0,0 +1,192 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#pragma once
+
+#include <snow/config.hh>
+#include <snow/io.hh>
+#include <snow/data/sparse.hh>
+#include <climits>
+#include <functional>
+#include <vector>
+
+
+namespace snow {
+
+
+/** @addtogroup Sparse Sparse
+  @{
+*/
+
+
+namespace sparse {
+
+
+/**
+  @brief Writes Sparse documents.
+
+  Names and values are escaped as needed, so parsing a writer's output yields
+  exactly the names and values that were written. Nodes are written one per
+  line and indented by depth:
+
+      writer_t writer;
+      writer.open("render");
+      writer.value("shadows", "on");
+      writer.close();
+      writer.finish();
+      // writer.data() is now "render {\n  shadows on\n}\n"
+
+  A writer constructed with a flush function passes its output on in batches
+  rather than keeping all of it, e.g. to a snow::io stream via flush_to_stream.
+  Otherwise, the writer's output accumulates in its buffer.
+
+  Nameless nodes (see SP_NAMELESS_NODES) are written by opening a node with an
+  empty name. Leaves must have names.
+*/
+struct S_EXPORT writer_t
+{
+  /**
+    Receives a batch of the writer's output. Returns false if the output
+    couldn't be written.
+  */
+  using flush_func_t = std::function<bool(const char *data, size_t length)>;
+
+  /** How many bytes a writer buffers before flushing by default. */
+  static const size_t DEFAULT_FLUSH_SIZE = 64 * 1024;
+
+
+  /** Constructs a writer that keeps all of its output in its buffer. */
+  writer_t();
+  /**
+    Constructs a writer that passes its output to flush whenever at least
+    flush_size bytes are buffered, and on flush() and finish().
+  */
+  explicit writer_t(flush_func_t flush, size_t flush_size = DEFAULT_FLUSH_SIZE);
+  /** Flushes any buffered output. Open nodes are left unclosed. */
+  ~writer_t();
+
+  writer_t(const writer_t &) = delete;
+  writer_t &operator = (const writer_t &) = delete;
+
+  /**
+    Sets the indentation used per level of depth. ch must be a space or a tab.
+    Defaults to two spaces.
+  */
+  void set_indent(size_t width, char ch = ' ');
+
+  /** Opens a node. An empty name opens a nameless node. */
+  void open(const char *name, size_t length);
+  /** @see open(const char *, size_t) */
+  void open(const string &name);
+  /** @see open(const char *, size_t) */
+  void open(const char *name);
+  /**
+    Closes the innermost open node. Throws std::logic_error if no node is
+    open.
+  */
+  void close();
+
+  /**
+    Writes a leaf node with the given name and value. Throws
+    std::invalid_argument if the name is empty.
+  */
+  void value(const char *name, size_t name_length,
+             const char *value, size_t value_length);
+  /** @see value(const char *, size_t, const char *, size_t) */
+  void value(const string &name, const string &value);
+  /** @see value(const char *, size_t, const char *, size_t) */
+  void value(const char *name, const char *value);
+
+  /**
+    Writes an element as the parser would report it, so a parser's output can
+    be passed straight on to a writer. SP_DONE finishes the document and
+    SP_ERROR is ignored. Throws std::logic_error if tokens are out of order.
+  */
+  void token(source_kind_t kind, const char *str, size_t length);
+
+  /**
+    Closes any open nodes and flushes the output. Returns false if any output
+    couldn't be flushed.
+  */
+  bool finish();
+  /**
+    Passes any buffered output to the flush function. Returns false if the
+    flush function fails, in which case the output is discarded and
+    have_error() is true. Does nothing for writers without a flush function.
+  */
+  bool flush();
+
+  /** Discards any buffered output and open nodes, and resets any error. */
+  void clear();
+
+  /** Returns the number of open nodes. */
+  inline size_t depth() const { return depth_; }
+  /** Returns whether any output couldn't be flushed. */
+  inline bool have_error() const { return failed_; }
+
+  /** Returns the buffered output. Not NUL-terminated. */
+  inline const char *data() const { return buffer_.data(); }
+  /** Returns the size of the buffered output in bytes. */
+  inline size_t size() const { return buffer_.size(); }
+
+private:
+  // Starts a line at the current depth.
+  void write_indent();
+  // Flushes if enough output is buffered.
+  void flush_if_full();
+
+
+  std::vector<char> buffer_;
+  flush_func_t      flush_;
+  size_t            flush_size_;
+  size_t            indent_width_;
+  char              indent_char_;
+  size_t            depth_;
+  bool              failed_;
+
+  // The last SP_NAME passed to token(), waiting for its value or node.
+  std::vector<char> name_;
+  bool              have_name_;
+};
+
+
+/**
+  Returns a writer_t flush function that writes to stream with io::write.
+  The stream must outlive the writer.
+*/
+template <class Stream>
+writer_t::flush_func_t flush_to_stream(Stream &stream);
+
+
+
+template <class Stream>
+writer_t::flush_func_t flush_to_stream(Stream &stream)
+{
+  return [&stream](const char *data, size_t length) {
+    // io::write takes an int, so write in chunks that fit
+    while (length > 0) {
+      const int chunk = int(std::min(length, size_t(INT_MAX)));
+      if (io::write(stream, chunk, data) != chunk) {
+        return false;
+      }
+      data += chunk;
+      length -= size_t(chunk);
+    }
+    return true;
+  };
+}
+
+
+} // namespace sparse
+
+
+/** @} */
+
+
+} // namespace snow
@@ -22,6 +22,7 @@
 
 // Types
 #include "types/binpack.hh"
+#include "types/flat_hash_map.hh"
 #include "types/object_pool.hh"
 #include "types/range.hh"
 #include "types/range_set.hh"
@@ -34,10 +35,18 @@
 
 // Data
 #include "data/hash.hh"
+#include "data/mapped_file.hh"
+#include "data/sketch.hh"
 #include "data/sparse.hh"
+#include "data/sparse_binding.hh"
+#include "data/sparse_document.hh"
+#include "data/sparse_value.hh"
+#include "data/sparse_writer.hh"
 
 // Strings
 #include "string/string.hh"
+#include "string/atom_table.hh"
+#include "string/hashed_string.hh"
 #include "string/compare.hh"
 #include "string/split.hh"
 #include "string/utf8.hh"
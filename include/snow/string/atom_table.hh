@@ -0,0 +1,106 @@
+/*
+ * Copyright Noel Cower 2013.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#pragma once
+
+#include <snow/config.hh>
+#include <cstdint>
+#include <memory>
+
+
+namespace snow {
+
+
+/**
+  An interned string ID. Two atoms from the same atom_table_t are equal if and
+  only if the strings they were interned from are equal.
+*/
+using atom_t = uint32_t;
+
+
+/**
+  @brief Interns strings as compact 32-bit atoms.
+
+  Each distinct string is copied once into the table's arena and assigned an
+  atom. Interning the same string again returns the same atom, so strings can
+  be compared by comparing their atoms. Interned strings are never freed or
+  moved until the table is destroyed, so pointers returned by c_str() remain
+  valid for the lifetime of the table.
+
+  A table is either thread-safe or not, as decided when it's constructed. A
+  thread-safe table is split into shards by hash, each with its own lock, so
+  threads interning different strings rarely contend. A table that isn't
+  thread-safe uses a single shard, takes no locks, and assigns atoms densely
+  starting at zero in the order strings are first interned.
+
+  Atoms are only meaningful to the table that produced them.
+*/
+struct S_EXPORT atom_table_t
+{
+  /** Number of shards used by a thread-safe table. */
+  static const size_t SHARD_COUNT = 16;
+
+
+  /**
+    Constructs an empty atom table. If thread_safe is true, the table may be
+    used from multiple threads concurrently.
+  */
+  explicit atom_table_t(bool thread_safe = false);
+  ~atom_table_t();
+
+  atom_table_t(const atom_table_t &) = delete;
+  atom_table_t &operator = (const atom_table_t &) = delete;
+
+
+  /** Returns whether the table was constructed as thread-safe. */
+  inline bool thread_safe() const { return shard_bits_ != 0; }
+
+  /**
+    Returns the atom for the given string, interning it if it hasn't been
+    interned before. Throws std::overflow_error if the table is out of atoms.
+  */
+  atom_t intern(const char *str, size_t length);
+  /** @see intern(const char *, size_t) */
+  atom_t intern(const string &str);
+
+  /**
+    Looks up the atom for a string without interning it. Returns true and
+    stores the atom in `out` if the string has been interned, otherwise
+    returns false.
+  */
+  bool find(const char *str, size_t length, atom_t &out) const;
+  /** @see find(const char *, size_t, atom_t &) const */
+  bool find(const string &str, atom_t &out) const;
+
+  /**
+    Returns a pointer to the NUL-terminated string for the given atom. The
+    pointer is valid until the table is destroyed.
+  */
+  const char *c_str(atom_t atom) const;
+  /** Returns the length of the string for the given atom. */
+  size_t length(atom_t atom) const;
+  /** Returns a copy of the string for the given atom. */
+  string str(atom_t atom) const;
+  /** Returns the hash64 of the string for the given atom. */
+  uint64_t hash(atom_t atom) const;
+
+  /** Returns the number of strings interned. */
+  size_t size() const;
+
+private:
+  struct shard_t;
+
+  const char *lookup(atom_t atom, size_t *length, uint64_t *hash) const;
+
+  uint32_t                   shard_bits_;
+  std::unique_ptr<shard_t[]> shards_;
+};
+
+
+} // namespace snow
@@ -0,0 +1,214 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#pragma once
+
+#include <snow/config.hh>
+#include <snow/data/hash.hh>
+#include <snow/types/flat_hash_map.hh>
+#include <cstring>
+#include <utility>
+
+
+namespace snow {
+
+
+/**
+  @brief A string that caches its hash.
+
+  Wraps a string_t along with its snow::hash64 digest (using the default
+  seed). The digest is computed the first time it's asked for and kept until
+  the string is modified, so a hashed_string_t can be hashed any number of
+  times -- e.g., when a hash table rehashes -- for the cost of hashing it
+  once. Equality compares cached digests first, so unequal strings rarely
+  need their contents compared.
+
+  The string can only be modified through hashed_string_t's own methods, all
+  of which discard the cached digest. For anything else, take the string out
+  with release(), modify it, and assign it back.
+
+  @note hash() modifies the cache on a const string. As such, a
+  hashed_string_t shared between threads should be hashed before it's shared.
+*/
+struct hashed_string_t
+{
+  using size_type = string_t::size_type;
+
+
+  hashed_string_t() = default;
+  hashed_string_t(const hashed_string_t &other) = default;
+  hashed_string_t(hashed_string_t &&other) :
+    str_(std::move(other.str_)), hash_(other.hash_), hashed_(other.hashed_)
+  {
+    other.hashed_ = false;
+  }
+
+  hashed_string_t(const string_t &str) : str_(str) {}
+  hashed_string_t(string_t &&str) : str_(std::move(str)) {}
+  hashed_string_t(const char *zstr) : str_(zstr) {}
+  hashed_string_t(const char *str, size_type length) : str_(str, length) {}
+
+  hashed_string_t &operator = (const hashed_string_t &other) = default;
+  hashed_string_t &operator = (hashed_string_t &&other)
+  {
+    str_ = std::move(other.str_);
+    hash_ = other.hash_;
+    hashed_ = other.hashed_;
+    other.hashed_ = false;
+    return *this;
+  }
+
+
+  /** Replaces the string. */
+  hashed_string_t &assign(const string_t &str)
+  {
+    str_ = str;
+    hashed_ = false;
+    return *this;
+  }
+
+  /** @see assign(const string_t &) */
+  hashed_string_t &assign(string_t &&str)
+  {
+    str_ = std::move(str);
+    hashed_ = false;
+    return *this;
+  }
+
+  /** @see assign(const string_t &) */
+  hashed_string_t &assign(const char *str, size_type length)
+  {
+    str_.assign(str, length);
+    hashed_ = false;
+    return *this;
+  }
+
+  /** Appends to the string. */
+  hashed_string_t &append(const string_t &str)
+  {
+    str_.append(str);
+    hashed_ = false;
+    return *this;
+  }
+
+  /** @see append(const string_t &) */
+  hashed_string_t &append(const char *str, size_type length)
+  {
+    str_.append(str, length);
+    hashed_ = false;
+    return *this;
+  }
+
+  /** Empties the string. */
+  hashed_string_t &clear()
+  {
+    str_.clear();
+    hashed_ = false;
+    return *this;
+  }
+
+  /** Moves the string out, leaving this empty. */
+  string_t release()
+  {
+    string_t result = std::move(str_);
+    str_.clear();
+    hashed_ = false;
+    return result;
+  }
+
+
+  /** Returns the string's hash64 digest, computing it if necessary. */
+  uint64_t hash() const
+  {
+    if (!hashed_) {
+      hash_ = hash64(str_);
+      hashed_ = true;
+    }
+    return hash_;
+  }
+
+  /** Returns whether the digest has been computed and cached. */
+  bool is_hashed() const { return hashed_; }
+
+
+  const string_t &str() const { return str_; }
+  operator const string_t & () const { return str_; }
+
+  const char *c_str() const { return str_.c_str(); }
+  const char *data() const { return str_.data(); }
+  size_type size() const { return str_.size(); }
+  bool empty() const { return str_.empty(); }
+
+
+  /**
+    Returns whether two strings are equal. If both have cached digests, those
+    are compared before the strings' contents.
+  */
+  friend bool operator == (const hashed_string_t &lhs, const hashed_string_t &rhs)
+  {
+    if (lhs.hashed_ && rhs.hashed_ && lhs.hash_ != rhs.hash_) {
+      return false;
+    }
+    return lhs.str_.size() == rhs.str_.size() &&
+           std::memcmp(lhs.str_.data(), rhs.str_.data(), size_t(lhs.str_.size())) == 0;
+  }
+
+  friend bool operator != (const hashed_string_t &lhs, const hashed_string_t &rhs)
+  {
+    return !(lhs == rhs);
+  }
+
+  friend bool operator < (const hashed_string_t &lhs, const hashed_string_t &rhs)
+  {
+    return lhs.str_.compare(rhs.str_) < 0;
+  }
+
+private:
+  string_t         str_;
+  mutable uint64_t hash_   = 0;
+  mutable bool     hashed_ = false;
+};
+
+
+/**
+  Hashes a hashed_string_t by its cached digest. Also accepts a pointer and
+  length, which hash the same as an equal hashed_string_t.
+*/
+template <>
+struct flat_hash_t<hashed_string_t>
+{
+  uint64_t operator () (const hashed_string_t &str) const
+  {
+    return str.hash();
+  }
+
+  uint64_t operator () (const char *str, size_t length) const
+  {
+    return hash64(str, length);
+  }
+};
+
+
+template <>
+struct flat_equal_t<hashed_string_t>
+{
+  bool operator () (const hashed_string_t &lhs, const hashed_string_t &rhs) const
+  {
+    return lhs == rhs;
+  }
+
+  bool operator () (const hashed_string_t &lhs, const char *str, size_t length) const
+  {
+    return size_t(lhs.size()) == length &&
+           std::memcmp(lhs.data(), str, length) == 0;
+  }
+};
+
+
+} // namespace snow
@@ -0,0 +1,882 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#pragma once
+
+#include <snow/config.hh>
+#include <snow/data/hash.hh>
+#include <snow/memory/align.hh>
+#include <snow/memory/allocator.hh>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <new>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+#if S_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+
+
+namespace snow {
+
+
+/** @addtogroup FlatHash Flat Hash Tables
+  @{
+*/
+
+
+/**
+  Default hash function for flat hash tables. Integers, enums, and pointers
+  hash to their value, and strings go through snow::hash64. Other types must
+  provide their own hash function. Tables mix every hash with hash_mix64, so
+  a hash function need not spread its bits itself.
+*/
+template <typename T, typename Enable = void>
+struct flat_hash_t;
+
+
+template <typename T>
+struct flat_hash_t<T, typename std::enable_if<(std::is_integral<T>::value ||
+                                               std::is_enum<T>::value) &&
+                                              sizeof(T) <= sizeof(uint64_t)>::type>
+{
+  uint64_t operator () (const T &value) const
+  {
+    return uint64_t(value);
+  }
+};
+
+
+template <typename T>
+struct flat_hash_t<T, typename std::enable_if<std::is_pointer<T>::value>::type>
+{
+  uint64_t operator () (const T &value) const
+  {
+    return uint64_t(uintptr_t(value));
+  }
+};
+
+
+template <>
+struct flat_hash_t<string_t>
+{
+  uint64_t operator () (const string_t &str) const
+  {
+    return hash64(str);
+  }
+
+  uint64_t operator () (const char *str, size_t length) const
+  {
+    return hash64(str, length);
+  }
+};
+
+
+/**
+  Default key comparison for flat hash tables. Uses operator ==, except for
+  strings, which may also be compared against a pointer and length.
+*/
+template <typename T>
+struct flat_equal_t
+{
+  bool operator () (const T &lhs, const T &rhs) const
+  {
+    return lhs == rhs;
+  }
+};
+
+
+template <>
+struct flat_equal_t<string_t>
+{
+  bool operator () (const string_t &lhs, const string_t &rhs) const
+  {
+    return lhs.size() == rhs.size() &&
+           std::memcmp(lhs.data(), rhs.data(), size_t(lhs.size())) == 0;
+  }
+
+  bool operator () (const string_t &lhs, const char *str, size_t length) const
+  {
+    return size_t(lhs.size()) == length &&
+           std::memcmp(lhs.data(), str, length) == 0;
+  }
+};
+
+
+/** @cond IGNORE */
+
+/*==============================================================================
+
+  A group of control bytes for a flat hash table. Each byte is either empty,
+  deleted, or holds the low 7 bits of the hash of the value in its slot. A
+  group is matched against a hash all at once, with SSE2 if available.
+
+==============================================================================*/
+struct flat_group_t
+{
+  static const size_t  width   = 16;
+  static const int8_t  empty   = -128;
+  static const int8_t  deleted = -2;
+
+  explicit flat_group_t(const int8_t *ctrl) : ctrl_(ctrl) {}
+
+  // Returns a bitmask of the bytes matching the given hash bits.
+  uint32_t match(int8_t h2) const
+  {
+#if S_SIMD_SSE2
+    const __m128i group = _mm_loadu_si128((const __m128i *)ctrl_);
+    return uint32_t(_mm_movemask_epi8(_mm_cmpeq_epi8(group, _mm_set1_epi8(h2))));
+#else
+    uint32_t mask = 0;
+    for (size_t index = 0; index < width; ++index) {
+      mask |= uint32_t(ctrl_[index] == h2) << index;
+    }
+    return mask;
+#endif
+  }
+
+  // Returns a bitmask of the empty bytes.
+  uint32_t match_empty() const
+  {
+    return match(empty);
+  }
+
+  // Returns a bitmask of bytes that are either empty or deleted.
+  uint32_t match_free() const
+  {
+#if S_SIMD_SSE2
+    const __m128i group = _mm_loadu_si128((const __m128i *)ctrl_);
+    return uint32_t(_mm_movemask_epi8(_mm_cmplt_epi8(group, _mm_set1_epi8(-1))));
+#else
+    uint32_t mask = 0;
+    for (size_t index = 0; index < width; ++index) {
+      mask |= uint32_t(ctrl_[index] < -1) << index;
+    }
+    return mask;
+#endif
+  }
+
+  // Returns the index of the lowest set bit in a nonzero mask.
+  static size_t first(uint32_t mask)
+  {
+#if S_GNU
+    return size_t(__builtin_ctz(mask));
+#else
+    size_t index = 0;
+    for (; !(mask & 1); mask >>= 1) {
+      ++index;
+    }
+    return index;
+#endif
+  }
+
+private:
+  const int8_t *ctrl_;
+};
+
+
+
+/*==============================================================================
+
+  Open-addressing hash table shared by flat_hash_map_t and flat_hash_set_t.
+  Control bytes and slots are kept in a single allocation with the slots
+  following the control bytes. The Policy describes the value type and how to
+  get a key from a value.
+
+  Hashes are mixed with hash_mix64 and then split into H1, which picks the
+  group probing starts at, and H2, the low 7 bits stored in a slot's control
+  byte. Groups are probed quadratically until a group containing an empty
+  byte is found.
+
+==============================================================================*/
+template <typename Policy, typename Hash, typename KeyEqual>
+struct flat_hash_table_t
+{
+  using key_type    = typename Policy::key_type;
+  using value_type  = typename Policy::value_type;
+  using size_type   = size_t;
+  using hasher      = Hash;
+  using key_equal   = KeyEqual;
+
+
+  template <typename V>
+  struct basic_iterator
+  {
+    using iterator_category = std::forward_iterator_tag;
+    using value_type        = V;
+    using difference_type   = ptrdiff_t;
+    using pointer           = V *;
+    using reference         = V &;
+
+    basic_iterator() = default;
+
+    // Allows conversion from iterator to const_iterator
+    template <typename U, typename = typename std::enable_if<
+      std::is_convertible<U *, V *>::value>::type>
+    basic_iterator(const basic_iterator<U> &other) :
+      ctrl_(other.ctrl_), end_(other.end_), slot_(other.slot_)
+    {
+      /* nop */
+    }
+
+    reference operator * () const { return *slot_; }
+    pointer operator -> () const { return slot_; }
+
+    basic_iterator &operator ++ ()
+    {
+      do {
+        ++ctrl_;
+        ++slot_;
+      } while (ctrl_ != end_ && *ctrl_ < 0);
+      return *this;
+    }
+
+    basic_iterator operator ++ (int)
+    {
+      basic_iterator cur = *this;
+      ++*this;
+      return cur;
+    }
+
+    bool operator == (const basic_iterator &other) const { return ctrl_ == other.ctrl_; }
+    bool operator != (const basic_iterator &other) const { return ctrl_ != other.ctrl_; }
+
+  private:
+    friend struct flat_hash_table_t;
+    template <typename U> friend struct basic_iterator;
+
+    basic_iterator(const int8_t *ctrl, const int8_t *end, V *slot) :
+      ctrl_(ctrl), end_(end), slot_(slot)
+    {
+      /* nop */
+    }
+
+    const int8_t *ctrl_ = nullptr;
+    const int8_t *end_  = nullptr;
+    V *slot_            = nullptr;
+  };
+
+  using iterator       = basic_iterator<value_type>;
+  using const_iterator = basic_iterator<const value_type>;
+
+
+  flat_hash_table_t() = default;
+
+  explicit flat_hash_table_t(size_type reserved,
+                             const hasher &hash = hasher(),
+                             const key_equal &equal = key_equal()) :
+    hash_(hash), equal_(equal)
+  {
+    reserve(reserved);
+  }
+
+  flat_hash_table_t(const flat_hash_table_t &other) :
+    hash_(other.hash_), equal_(other.equal_)
+  {
+    copy_from(other);
+  }
+
+  flat_hash_table_t(flat_hash_table_t &&other) :
+    hash_(std::move(other.hash_)), equal_(std::move(other.equal_))
+  {
+    steal(other);
+  }
+
+  ~flat_hash_table_t()
+  {
+    destroy();
+  }
+
+  flat_hash_table_t &operator = (const flat_hash_table_t &other)
+  {
+    if (this != &other) {
+      destroy();
+      hash_ = other.hash_;
+      equal_ = other.equal_;
+      copy_from(other);
+    }
+    return *this;
+  }
+
+  flat_hash_table_t &operator = (flat_hash_table_t &&other)
+  {
+    if (this != &other) {
+      destroy();
+      hash_ = std::move(other.hash_);
+      equal_ = std::move(other.equal_);
+      steal(other);
+    }
+    return *this;
+  }
+
+
+  iterator begin() { return iterator_at(first_full()); }
+  iterator end() { return iterator_at(capacity_); }
+  const_iterator begin() const { return iterator_at(first_full()); }
+  const_iterator end() const { return iterator_at(capacity_); }
+  const_iterator cbegin() const { return begin(); }
+  const_iterator cend() const { return end(); }
+
+
+  /** Returns the number of values in the table. */
+  size_type size() const { return size_; }
+  /** Returns whether the table is empty. */
+  bool empty() const { return size_ == 0; }
+  /** Returns the number of slots in the table. */
+  size_type capacity() const { return capacity_; }
+
+
+  /** Destroys all values in the table. Does not release memory. */
+  void clear()
+  {
+    destroy_values();
+    if (capacity_) {
+      std::memset(ctrl_, flat_group_t::empty, capacity_);
+    }
+    size_ = 0;
+    growth_left_ = max_load(capacity_);
+  }
+
+  /** Ensures the table can hold count values without rehashing. */
+  void reserve(size_type count)
+  {
+    if (count > max_load(capacity_)) {
+      rehash(capacity_for(count));
+    }
+  }
+
+
+  /** Returns an iterator to the value with the given key, or end(). */
+  iterator find(const key_type &key)
+  {
+    return iterator_at(find_slot(hash_of(key), key));
+  }
+
+  const_iterator find(const key_type &key) const
+  {
+    return iterator_at(find_slot(hash_of(key), key));
+  }
+
+  /**
+    Returns an iterator to the value whose key is equal to the given string,
+    or end(). Both the hasher and key_equal must accept a pointer and length
+    (as the defaults for string_t keys do).
+  */
+  iterator find(const char *str, size_type length)
+  {
+    return iterator_at(find_slot(hash_of(str, length), str, length));
+  }
+
+  const_iterator find(const char *str, size_type length) const
+  {
+    return iterator_at(find_slot(hash_of(str, length), str, length));
+  }
+
+  /**
+    Returns an iterator to the value whose key is equal to the given lookup
+    key, or end(). Both the hasher and key_equal must accept the lookup key,
+    and it must hash the same as an equal key.
+  */
+  template <typename LookupKey>
+  iterator find_as(const LookupKey &key)
+  {
+    return iterator_at(find_slot(hash_of(key), key));
+  }
+
+  template <typename LookupKey>
+  const_iterator find_as(const LookupKey &key) const
+  {
+    return iterator_at(find_slot(hash_of(key), key));
+  }
+
+  /** Returns the number of values with the given key (either 0 or 1). */
+  size_type count(const key_type &key) const
+  {
+    return find_slot(hash_of(key), key) != capacity_;
+  }
+
+  size_type count(const char *str, size_type length) const
+  {
+    return find_slot(hash_of(str, length), str, length) != capacity_;
+  }
+
+
+  /**
+    Inserts a value if there's no value with the same key already. Returns an
+    iterator to the value with the key and whether it was inserted.
+  */
+  std::pair<iterator, bool> insert(const value_type &value)
+  {
+    return emplace_key(Policy::key(value), value);
+  }
+
+  std::pair<iterator, bool> insert(value_type &&value)
+  {
+    return emplace_key(Policy::key(value), std::move(value));
+  }
+
+
+  /** Removes the value at the given iterator. Returns the following iterator. */
+  iterator erase(const_iterator pos)
+  {
+    const size_type slot = size_type(pos.slot_ - slots_);
+    erase_slot(slot);
+    iterator next = iterator_at(slot);
+    if (slot != capacity_ && ctrl_[slot] < 0) {
+      ++next;
+    }
+    return next;
+  }
+
+  /** Removes the value with the given key, if any. Returns the number removed. */
+  size_type erase(const key_type &key)
+  {
+    const size_type slot = find_slot(hash_of(key), key);
+    if (slot == capacity_) {
+      return 0;
+    }
+    erase_slot(slot);
+    return 1;
+  }
+
+
+  /** Rebuilds the table with room for at least the given number of slots. */
+  void rehash(size_type min_capacity)
+  {
+    size_type new_capacity = capacity_for(size_);
+    while (new_capacity < min_capacity) {
+      new_capacity *= 2;
+    }
+    resize(new_capacity);
+  }
+
+
+  void swap(flat_hash_table_t &other)
+  {
+    std::swap(ctrl_, other.ctrl_);
+    std::swap(slots_, other.slots_);
+    std::swap(capacity_, other.capacity_);
+    std::swap(size_, other.size_);
+    std::swap(growth_left_, other.growth_left_);
+    std::swap(hash_, other.hash_);
+    std::swap(equal_, other.equal_);
+  }
+
+
+  hasher hash_function() const { return hash_; }
+  key_equal key_eq() const { return equal_; }
+
+
+protected:
+  using allocator_t = aligned_mallocator<
+    (alignof(value_type) > flat_group_t::width ? alignof(value_type) : flat_group_t::width)>;
+
+
+  // Looks up the key and inserts a value constructed from args if it's not
+  // found. The key is only used for lookup.
+  template <typename... ARGS>
+  std::pair<iterator, bool> emplace_key(const key_type &key, ARGS &&... args)
+  {
+    const uint64_t hash = hash_of(key);
+    size_type slot = find_slot(hash, key);
+    if (slot != capacity_) {
+      return { iterator_at(slot), false };
+    }
+
+    slot = prepare_insert(hash);
+    new(slots_ + slot) value_type(std::forward<ARGS>(args)...);
+    return { iterator_at(slot), true };
+  }
+
+
+  template <typename... KEY>
+  size_type find_slot(uint64_t hash, const KEY &... key) const
+  {
+    if (capacity_ == 0) {
+      return capacity_;
+    }
+
+    const int8_t h2 = int8_t(hash & 0x7F);
+    const size_type group_mask = capacity_ / flat_group_t::width - 1;
+    size_type group = size_type(hash >> 7) & group_mask;
+    for (size_type step = 1;; ++step) {
+      const size_type base = group * flat_group_t::width;
+      const flat_group_t ctrl(ctrl_ + base);
+      for (uint32_t match = ctrl.match(h2); match; match &= match - 1) {
+        const size_type slot = base + flat_group_t::first(match);
+        if (equal_(Policy::key(slots_[slot]), key...)) {
+          return slot;
+        }
+      }
+
+      if (ctrl.match_empty()) {
+        return capacity_;
+      }
+
+      group = (group + step) & group_mask;
+    }
+  }
+
+
+  // Finds a free slot for a value with the given hash, marks it full, and
+  // returns it. The caller must construct the value in the slot.
+  size_type prepare_insert(uint64_t hash)
+  {
+    if (growth_left_ == 0) {
+      // Rebuilding at the same capacity is enough if most of what's used up
+      // the table's growth is deleted slots.
+      resize(size_ < max_load(capacity_) / 2 ? capacity_ : capacity_for(size_ + 1));
+    }
+
+    const size_type slot = find_free(hash);
+    if (ctrl_[slot] == flat_group_t::empty) {
+      --growth_left_;
+    }
+    ctrl_[slot] = int8_t(hash & 0x7F);
+    ++size_;
+    return slot;
+  }
+
+
+  void erase_slot(size_type slot)
+  {
+    slots_[slot].~value_type();
+    --size_;
+
+    // If the group still has an empty slot, no probe has ever continued past
+    // it, so the slot can be marked empty rather than deleted.
+    const size_type base = slot & ~(flat_group_t::width - 1);
+    if (flat_group_t(ctrl_ + base).match_empty()) {
+      ctrl_[slot] = flat_group_t::empty;
+      ++growth_left_;
+    } else {
+      ctrl_[slot] = flat_group_t::deleted;
+    }
+  }
+
+
+  value_type &slot_value(size_type slot) { return slots_[slot]; }
+
+
+private:
+  static size_type max_load(size_type capacity)
+  {
+    return capacity - capacity / 8;
+  }
+
+  // Returns the smallest valid capacity that can hold count values.
+  static size_type capacity_for(size_type count)
+  {
+    size_type capacity = flat_group_t::width;
+    while (max_load(capacity) < count) {
+      capacity *= 2;
+    }
+    return capacity;
+  }
+
+  static size_type slots_offset(size_type capacity)
+  {
+    return align(capacity, alignof(value_type));
+  }
+
+
+  // Hashes a key with the hasher and mixes the result, since H1 and H2 are
+  // taken straight from its bits.
+  template <typename... KEY>
+  uint64_t hash_of(const KEY &... key) const
+  {
+    return hash_mix64(hash_(key...));
+  }
+
+
+  size_type find_free(uint64_t hash) const
+  {
+    const size_type group_mask = capacity_ / flat_group_t::width - 1;
+    size_type group = size_type(hash >> 7) & group_mask;
+    for (size_type step = 1;; ++step) {
+      const size_type base = group * flat_group_t::width;
+      const uint32_t free_mask = flat_group_t(ctrl_ + base).match_free();
+      if (free_mask) {
+        return base + flat_group_t::first(free_mask);
+      }
+      group = (group + step) & group_mask;
+    }
+  }
+
+
+  size_type first_full() const
+  {
+    size_type slot = 0;
+    while (slot < capacity_ && ctrl_[slot] < 0) {
+      ++slot;
+    }
+    return slot;
+  }
+
+  iterator iterator_at(size_type slot)
+  {
+    return iterator(ctrl_ + slot, ctrl_ + capacity_, slots_ + slot);
+  }
+
+  const_iterator iterator_at(size_type slot) const
+  {
+    return const_iterator(ctrl_ + slot, ctrl_ + capacity_, slots_ + slot);
+  }
+
+
+  void allocate(size_type capacity)
+  {
+    const size_type bytes = slots_offset(capacity) + capacity * sizeof(value_type);
+    void *const block = allocator_t().allocate(bytes);
+    if (block == nullptr) {
+      s_throw(std::runtime_error, "Unable to allocate flat hash table");
+    }
+
+    ctrl_ = (int8_t *)block;
+    slots_ = (value_type *)((char *)block + slots_offset(capacity));
+    capacity_ = capacity;
+    std::memset(ctrl_, flat_group_t::empty, capacity);
+  }
+
+
+  void resize(size_type new_capacity)
+  {
+    int8_t *const old_ctrl = ctrl_;
+    value_type *const old_slots = slots_;
+    const size_type old_capacity = capacity_;
+
+    allocate(new_capacity);
+    growth_left_ = max_load(new_capacity) - size_;
+
+    for (size_type slot = 0; slot < old_capacity; ++slot) {
+      if (old_ctrl[slot] >= 0) {
+        value_type &value = old_slots[slot];
+        const uint64_t hash = hash_of(Policy::key(value));
+        const size_type new_slot = find_free(hash);
+        ctrl_[new_slot] = int8_t(hash & 0x7F);
+        new(slots_ + new_slot) value_type(std::move(value));
+        value.~value_type();
+      }
+    }
+
+    if (old_ctrl) {
+      allocator_t().deallocate(old_ctrl);
+    }
+  }
+
+
+  void copy_from(const flat_hash_table_t &other)
+  {
+    if (other.capacity_ == 0) {
+      return;
+    }
+
+    // Same capacity and hash function, so every value can stay in its slot.
+    allocate(other.capacity_);
+    for (size_type slot = 0; slot < capacity_; ++slot) {
+      if (other.ctrl_[slot] >= 0) {
+        new(slots_ + slot) value_type(other.slots_[slot]);
+      }
+    }
+    std::memcpy(ctrl_, other.ctrl_, capacity_);
+    size_ = other.size_;
+    growth_left_ = other.growth_left_;
+  }
+
+
+  void steal(flat_hash_table_t &other)
+  {
+    ctrl_ = other.ctrl_;
+    slots_ = other.slots_;
+    capacity_ = other.capacity_;
+    size_ = other.size_;
+    growth_left_ = other.growth_left_;
+    other.ctrl_ = nullptr;
+    other.slots_ = nullptr;
+    other.capacity_ = 0;
+    other.size_ = 0;
+    other.growth_left_ = 0;
+  }
+
+
+  void destroy_values()
+  {
+    if (!std::is_trivially_destructible<value_type>::value) {
+      for (size_type slot = 0; slot < capacity_; ++slot) {
+        if (ctrl_[slot] >= 0) {
+          slots_[slot].~value_type();
+        }
+      }
+    }
+  }
+
+
+  void destroy()
+  {
+    destroy_values();
+    if (ctrl_) {
+      allocator_t().deallocate(ctrl_);
+    }
+    ctrl_ = nullptr;
+    slots_ = nullptr;
+    capacity_ = 0;
+    size_ = 0;
+    growth_left_ = 0;
+  }
+
+
+  int8_t     *ctrl_       = nullptr;
+  value_type *slots_      = nullptr;
+  size_type   capacity_   = 0;
+  size_type   size_       = 0;
+  size_type   growth_left_ = 0;
+  hasher      hash_;
+  key_equal   equal_;
+};
+
+
+template <typename Key, typename T>
+struct flat_map_policy_t
+{
+  using key_type   = Key;
+  using value_type = std::pair<Key, T>;
+  static const key_type &key(const value_type &value) { return value.first; }
+};
+
+
+template <typename Key>
+struct flat_set_policy_t
+{
+  using key_type   = Key;
+  using value_type = Key;
+  static const key_type &key(const value_type &value) { return value; }
+};
+
+/** @endcond */
+
+
+
+/**
+  An open-addressing hash map. Keys and values are stored together in one
+  contiguous array of slots alongside an array of control bytes, so lookups
+  don't chase pointers and usually touch a single group of control bytes.
+
+  Values are moved when the table is rehashed, so iterators and references
+  to values are invalidated by any insertion. Keys must not be modified
+  through iterators.
+
+  With the default hasher and key_equal, string_t keys may also be looked up
+  by a pointer and length without constructing a string_t.
+*/
+template <typename Key, typename T,
+          typename Hash = flat_hash_t<Key>,
+          typename KeyEqual = flat_equal_t<Key>>
+struct flat_hash_map_t
+  : public flat_hash_table_t<flat_map_policy_t<Key, T>, Hash, KeyEqual>
+{
+  using table_type  = flat_hash_table_t<flat_map_policy_t<Key, T>, Hash, KeyEqual>;
+  using key_type    = Key;
+  using mapped_type = T;
+  using value_type  = typename table_type::value_type;
+  using iterator    = typename table_type::iterator;
+  using size_type   = typename table_type::size_type;
+
+  using table_type::table_type;
+
+
+  /**
+    Inserts a value constructed from args for the key if the key isn't in the
+    map already.
+  */
+  template <typename... ARGS>
+  std::pair<iterator, bool> try_emplace(const key_type &key, ARGS &&... args)
+  {
+    return this->emplace_key(key, std::piecewise_construct,
+                             std::forward_as_tuple(key),
+                             std::forward_as_tuple(std::forward<ARGS>(args)...));
+  }
+
+  template <typename... ARGS>
+  std::pair<iterator, bool> try_emplace(key_type &&key, ARGS &&... args)
+  {
+    return this->emplace_key(key, std::piecewise_construct,
+                             std::forward_as_tuple(std::move(key)),
+                             std::forward_as_tuple(std::forward<ARGS>(args)...));
+  }
+
+
+  /** Returns the value for the key, default-constructing it if necessary. */
+  mapped_type &operator [] (const key_type &key)
+  {
+    return try_emplace(key).first->second;
+  }
+
+  mapped_type &operator [] (key_type &&key)
+  {
+    return try_emplace(std::move(key)).first->second;
+  }
+
+
+  /** Returns the value for the key. Throws if the key isn't in the map. */
+  mapped_type &at(const key_type &key)
+  {
+    const auto iter = this->find(key);
+    if (iter == this->end()) {
+      s_throw(std::out_of_range, "Key is not in the map");
+    }
+    return iter->second;
+  }
+
+  const mapped_type &at(const key_type &key) const
+  {
+    const auto iter = this->find(key);
+    if (iter == this->end()) {
+      s_throw(std::out_of_range, "Key is not in the map");
+    }
+    return iter->second;
+  }
+};
+
+
+
+/**
+  An open-addressing hash set.
+  @see snow::flat_hash_map_t
+*/
+template <typename Key,
+          typename Hash = flat_hash_t<Key>,
+          typename KeyEqual = flat_equal_t<Key>>
+struct flat_hash_set_t
+  : public flat_hash_table_t<flat_set_policy_t<Key>, Hash, KeyEqual>
+{
+  using table_type = flat_hash_table_t<flat_set_policy_t<Key>, Hash, KeyEqual>;
+  using key_type   = Key;
+  using value_type = typename table_type::value_type;
+  using iterator   = typename table_type::iterator;
+
+  using table_type::table_type;
+
+
+  /** Inserts a key constructed from args if it isn't in the set already. */
+  template <typename... ARGS>
+  std::pair<iterator, bool> emplace(ARGS &&... args)
+  {
+    key_type key(std::forward<ARGS>(args)...);
+    return this->emplace_key(key, std::move(key));
+  }
+};
+
+
+/** @} */
+
+
+} // namespace snow
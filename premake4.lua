@@ -206,6 +206,11 @@ newoption {
   description = "Disables exceptions in snow-common -- replaces throws with exit(1)"
 }
 
+newoption {
+  trigger = "with-bench",
+  description = "Also generates the snow-hash-bench benchmark project"
+}
+
 newoption {
   trigger = "prefix",
   description = "Installation prefix",
@@ -309,7 +314,7 @@ g_pkgconfig_opts = {
   PREFIX = g_prefix,
   VERSION = g_version,
   PRIVATE_PKGS = "",
-  PRIVATE_LIBS = ""
+  PRIVATE_LIBS = "-pthread"
 }
 
 -- Exceptions
@@ -328,6 +333,11 @@ links { "c++" }
 configuration { "macosx", "*-Shared" }
 links { "Cocoa.framework" }
 
+-- std::thread needs pthreads, which older glibc keeps out of libc
+configuration "not windows"
+buildoptions { "-pthread" }
+linkoptions { "-pthread" }
+
 configuration {}
 
 -- Generate build-config/pkg-config
@@ -348,3 +358,31 @@ if _ACTION and _ACTION ~= "install" then
     return false
   end
 end
+
+
+-- Benchmarks (not installed)
+if _OPTIONS["with-bench"] then
+  project "snow-hash-bench"
+  kind "ConsoleApp"
+  language "C++"
+  targetdir "bin"
+  objdir "obj"
+  buildoptions { "-std=c++11" }
+  includedirs { "include" }
+  files { "bench/hash_bench.cc" }
+  links { "snow-common", "pthread" }
+
+  configuration "Release-*"
+  defines { "NDEBUG" }
+  flags { "Optimize" }
+
+  configuration "Debug-*"
+  defines { "DEBUG" }
+  flags { "Symbols" }
+
+  configuration "macosx"
+  buildoptions { "-stdlib=libc++" }
+  links { "c++" }
+
+  configuration {}
+end
@@ -43,6 +43,7 @@ size_t buffer_stream_t::write(const void *buffer, size_t length)
   length = std::min(length, remainder());
   if (length) {
     std::memmove(offset_, buffer, length);
+    seek(tell() + length);
   }
   return length;
 }
@@ -8,11 +8,517 @@
 
 
 #include <snow/data/hash.hh>
+#include <snow/endian.hh>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <thread>
+#include <vector>
+
+#if S_SIMD_DISPATCH
+#include <immintrin.h>
+#endif
 
 
 namespace snow {
 
 
+namespace {
+
+
+/*==============================================================================
+  hash64_at(cstring, length, seed, offset)
+
+    Implementation of hash64. The offset is the number of bytes hashed before
+    str, since each byte's position is mixed into the hash -- hash64 always
+    starts at zero, hasher64_t continues from however much it's consumed.
+==============================================================================*/
+uint64_t hash64_at(const char *str, const size_t length, uint64_t seed,
+                   uint64_t offset)
+{
+  static uint64_t mask_left[16] = {
+    0x0000ULL << 48, 0x8000ULL << 48, 0xC000ULL << 48, 0xE000ULL << 48,
+    0xF000ULL << 48, 0xF800ULL << 48, 0xFC00ULL << 48, 0xFE00ULL << 48,
+    0xFF00ULL << 48, 0xFF80ULL << 48, 0xFFC0ULL << 48, 0xFFE0ULL << 48,
+    0xFFF0ULL << 48, 0xFFF8ULL << 48, 0xFFFCULL << 48, 0xFFFEULL << 48,
+  };
+  uint64_t hash = seed;
+  constexpr uint64_t hbits = sizeof(hash) * 8;
+  uint64_t index = 0;
+  for (; index < length; ++index) {
+    const uint64_t curchar = str[index];
+    hash = hash * 5741U + curchar * 23U + (offset + index + 257U);
+    const uint64_t shift =
+      ((curchar & 0x9) | ((curchar & 0x10) >> 2) | ((curchar & 0x40) >> 5)) ^
+      ((curchar & 0xA) >> 5) | ((curchar & 0x2) << 2) | ((curchar & 0x4) >> 1);
+    hash = (hash << shift) | (hash & mask_left[shift]) >> (hbits - shift);
+  }
+  return hash;
+}
+
+
+
+#if S_SIMD_DISPATCH
+
+/*==============================================================================
+  cpu_has_avx2()
+
+    Returns whether AVX2 code paths may be used on this CPU.
+==============================================================================*/
+inline bool cpu_has_avx2()
+{
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  return has_avx2;
+}
+
+#endif // S_SIMD_DISPATCH
+
+
+
+/// Block hash constants
+
+// Number of bytes consumed per word and per stripe (four words) by
+// hash64_block.
+const size_t BLOCK_WORD_SIZE   = 8;
+const size_t BLOCK_STRIPE_SIZE = 4 * BLOCK_WORD_SIZE;
+// Minimum number of stripes before it's worth dispatching to a SIMD path.
+const size_t BLOCK_SIMD_MIN_STRIPES = 4;
+
+// Key mixed into each word before its halves are multiplied.
+const uint64_t BLOCK_MIX_KEY = 0x9E3779B97F4A7C15ULL;
+
+// Multiplier for the block state. Must be odd.
+constexpr uint64_t BLOCK_PRIME   = 0xC2B2AE3D27D4EB4FULL;
+constexpr uint64_t BLOCK_PRIME_2 = BLOCK_PRIME * BLOCK_PRIME;
+constexpr uint64_t BLOCK_PRIME_3 = BLOCK_PRIME_2 * BLOCK_PRIME;
+constexpr uint64_t BLOCK_PRIME_4 = BLOCK_PRIME_2 * BLOCK_PRIME_2;
+
+// Finalizer multipliers (from MurmurHash3's fmix64) and their inverses.
+constexpr uint64_t BLOCK_FINISH_1 = 0xFF51AFD7ED558CCDULL;
+constexpr uint64_t BLOCK_FINISH_2 = 0xC4CEB9FE1A85EC53ULL;
+
+
+/*==============================================================================
+  mul_inverse64(odd, guess, steps)
+
+    Returns the multiplicative inverse of an odd number modulo 2^64 by Newton's
+    method. An odd number is its own inverse to three bits, and each step
+    doubles the number of correct bits, so five steps are sufficient.
+==============================================================================*/
+constexpr uint64_t mul_inverse64(uint64_t odd, uint64_t guess, int steps)
+{
+  return steps == 0
+         ? guess
+         : mul_inverse64(odd, guess * (2 - odd * guess), steps - 1);
+}
+
+constexpr uint64_t BLOCK_UNFINISH_1 = mul_inverse64(BLOCK_FINISH_1, BLOCK_FINISH_1, 5);
+constexpr uint64_t BLOCK_UNFINISH_2 = mul_inverse64(BLOCK_FINISH_2, BLOCK_FINISH_2, 5);
+
+static_assert(BLOCK_FINISH_1 * BLOCK_UNFINISH_1 == 1 &&
+              BLOCK_FINISH_2 * BLOCK_UNFINISH_2 == 1,
+              "Block hash finalizer must be invertible");
+
+
+
+/*==============================================================================
+  block_finish(state)
+
+    Mixes the block hash state into its final digest. Every step is
+    invertible (see block_unfinish), which is what allows a digest to be used
+    as the seed for further input.
+==============================================================================*/
+inline uint64_t block_finish(uint64_t state)
+{
+  state ^= state >> 33;
+  state *= BLOCK_FINISH_1;
+  state ^= state >> 33;
+  state *= BLOCK_FINISH_2;
+  state ^= state >> 33;
+  return state;
+}
+
+
+
+/*==============================================================================
+  block_unfinish(digest)
+
+    Inverse of block_finish. Since the xor-shifts shift by at least half the
+    width of the state, each is its own inverse.
+==============================================================================*/
+inline uint64_t block_unfinish(uint64_t digest)
+{
+  digest ^= digest >> 33;
+  digest *= BLOCK_UNFINISH_2;
+  digest ^= digest >> 33;
+  digest *= BLOCK_UNFINISH_1;
+  digest ^= digest >> 33;
+  return digest;
+}
+
+
+
+/*==============================================================================
+  block_load(str)
+
+    Loads an unaligned little-endian word from str.
+==============================================================================*/
+inline uint64_t block_load(const char *str)
+{
+  uint64_t word;
+  std::memcpy(&word, str, sizeof(word));
+#if S_HOST_IS_BIG_ENDIAN
+  word = __builtin_bswap64(word);
+#endif
+  return word;
+}
+
+
+
+/*==============================================================================
+  block_load_tail(str, length)
+
+    Loads fewer than BLOCK_WORD_SIZE bytes as a little-endian word, storing the
+    length in the otherwise-unused top byte so that trailing zeroes aren't lost.
+==============================================================================*/
+inline uint64_t block_load_tail(const char *str, size_t length)
+{
+  uint64_t word = uint64_t(length) << 56;
+  for (size_t index = 0; index < length; ++index) {
+    word |= uint64_t(uint8_t(str[index])) << (index * 8);
+  }
+  return word;
+}
+
+
+
+/*==============================================================================
+  block_mix(word)
+
+    Mixes a single input word before it's added to the block state. The
+    product of the keyed word's halves is what spreads the high input bits into
+    the low bits of the state.
+==============================================================================*/
+inline uint64_t block_mix(uint64_t word)
+{
+  const uint64_t keyed = word ^ BLOCK_MIX_KEY;
+  return (keyed & 0xFFFFFFFFULL) * (keyed >> 32) + word;
+}
+
+
+
+/*==============================================================================
+  block_stripes_scalar(str, stripes, state)
+
+    Consumes whole stripes of input. The block state is a polynomial over the
+    mixed words in BLOCK_PRIME, so each stripe's words can be accumulated in
+    independent lanes -- each lane steps by BLOCK_PRIME^4 -- and recombined
+    at the end with the same result as consuming one word at a time. The
+    incoming state starts in the last lane, as it's multiplied by
+    BLOCK_PRIME^4 per stripe.
+==============================================================================*/
+uint64_t block_stripes_scalar(const char *str, size_t stripes, uint64_t state)
+{
+  uint64_t lane0 = 0;
+  uint64_t lane1 = 0;
+  uint64_t lane2 = 0;
+  uint64_t lane3 = state;
+  for (; stripes; --stripes, str += BLOCK_STRIPE_SIZE) {
+    lane0 = lane0 * BLOCK_PRIME_4 + block_mix(block_load(str));
+    lane1 = lane1 * BLOCK_PRIME_4 + block_mix(block_load(str + 8));
+    lane2 = lane2 * BLOCK_PRIME_4 + block_mix(block_load(str + 16));
+    lane3 = lane3 * BLOCK_PRIME_4 + block_mix(block_load(str + 24));
+  }
+  return lane0 * BLOCK_PRIME_3 + lane1 * BLOCK_PRIME_2 + lane2 * BLOCK_PRIME + lane3;
+}
+
+
+
+#if S_SIMD_DISPATCH
+
+/*==============================================================================
+  block_stripes_avx2(str, stripes, state)
+
+    AVX2 version of block_stripes_scalar, with one stripe per register. AVX2
+    has no 64-bit multiply, so the lane multiply is built from three 32-bit
+    multiplies. x86 is little-endian, so words are loaded as-is.
+==============================================================================*/
+__attribute__((target("avx2")))
+uint64_t block_stripes_avx2(const char *str, size_t stripes, uint64_t state)
+{
+  const __m256i key      = _mm256_set1_epi64x(int64_t(BLOCK_MIX_KEY));
+  const __m256i prime_lo = _mm256_set1_epi64x(int64_t(BLOCK_PRIME_4 & 0xFFFFFFFFULL));
+  const __m256i prime_hi = _mm256_set1_epi64x(int64_t(BLOCK_PRIME_4 >> 32));
+  __m256i lanes = _mm256_set_epi64x(int64_t(state), 0, 0, 0);
+
+  for (; stripes; --stripes, str += BLOCK_STRIPE_SIZE) {
+    const __m256i words = _mm256_loadu_si256((const __m256i *)str);
+    const __m256i keyed = _mm256_xor_si256(words, key);
+    const __m256i mixed = _mm256_add_epi64(
+      _mm256_mul_epu32(keyed, _mm256_srli_epi64(keyed, 32)),
+      words);
+
+    const __m256i cross = _mm256_add_epi64(
+      _mm256_mul_epu32(lanes, prime_hi),
+      _mm256_mul_epu32(_mm256_srli_epi64(lanes, 32), prime_lo));
+    lanes = _mm256_add_epi64(
+      _mm256_add_epi64(_mm256_mul_epu32(lanes, prime_lo),
+                       _mm256_slli_epi64(cross, 32)),
+      mixed);
+  }
+
+  uint64_t lane[4];
+  _mm256_storeu_si256((__m256i *)lane, lanes);
+  return lane[0] * BLOCK_PRIME_3 + lane[1] * BLOCK_PRIME_2 + lane[2] * BLOCK_PRIME + lane[3];
+}
+
+#endif // S_SIMD_DISPATCH
+
+
+
+/*==============================================================================
+  block_stripes(str, stripes, state)
+
+    Picks the fastest available implementation for consuming stripes.
+==============================================================================*/
+inline uint64_t block_stripes(const char *str, size_t stripes, uint64_t state)
+{
+#if S_SIMD_DISPATCH
+  if (stripes >= BLOCK_SIMD_MIN_STRIPES && cpu_has_avx2()) {
+    return block_stripes_avx2(str, stripes, state);
+  }
+#endif
+  return block_stripes_scalar(str, stripes, state);
+}
+
+
+/// Parallel hash constants
+
+// Keys mixed into the seed for hash64_parallel's inner and root nodes, to
+// keep them distinct from leaves and from each other.
+const uint64_t PARALLEL_NODE_KEY = 0x6A09E667F3BCC908ULL;
+const uint64_t PARALLEL_ROOT_KEY = 0xBB67AE8584CAA73BULL;
+
+
+
+/*==============================================================================
+  parallel_store(out, word)
+
+    Stores a word as little-endian bytes, so that tree nodes hash the same on
+    any host.
+==============================================================================*/
+inline void parallel_store(char *out, uint64_t word)
+{
+#if S_HOST_IS_BIG_ENDIAN
+  word = __builtin_bswap64(word);
+#endif
+  std::memcpy(out, &word, sizeof(word));
+}
+
+
+#if S_SIMD_DISPATCH
+
+/// Batch hash constants
+
+// Number of keys hashed in parallel by hash64_batch_avx2: two registers of
+// four 64-bit lanes each, so that one register's multiply latency is hidden
+// behind the other's.
+const size_t BATCH_LANES = 8;
+// Keys are fed to lanes a word at a time.
+const size_t BATCH_WORD_SIZE = 8;
+
+
+
+/*==============================================================================
+  batch_shifts(words)
+
+    Computes hash64's rotate amount for every byte of the words at once. The
+    rotate only depends on bits 0-4 and 6 of a byte, and the contributions of
+    each nibble are independent, so it's the or of a lookup of each nibble:
+
+      low nibble:  (c & 0x9) | ((c & 0x2) << 2) | ((c & 0x4) >> 1)
+      high nibble: ((c & 0x10) >> 2) | ((c & 0x40) >> 5)
+==============================================================================*/
+__attribute__((target("avx2")))
+inline __m256i batch_shifts(__m256i words)
+{
+  const __m256i low_table = _mm256_setr_epi8(
+    0, 1, 8, 9, 2, 3, 10, 11, 8, 9, 8, 9, 10, 11, 10, 11,
+    0, 1, 8, 9, 2, 3, 10, 11, 8, 9, 8, 9, 10, 11, 10, 11);
+  const __m256i high_table = _mm256_setr_epi8(
+    0, 4, 0, 4, 2, 6, 2, 6, 0, 4, 0, 4, 2, 6, 2, 6,
+    0, 4, 0, 4, 2, 6, 2, 6, 0, 4, 0, 4, 2, 6, 2, 6);
+  const __m256i nibble = _mm256_set1_epi8(0x0F);
+  return _mm256_or_si256(
+    _mm256_shuffle_epi8(low_table, _mm256_and_si256(words, nibble)),
+    _mm256_shuffle_epi8(high_table,
+                        _mm256_and_si256(_mm256_srli_epi16(words, 4), nibble)));
+}
+
+
+
+/*==============================================================================
+  batch_step(hash, words, shifts, index, byte)
+
+    One iteration of the hash64_at loop for four lanes at once, consuming the
+    given byte of each lane's word.
+
+    hash64_at converts each char to uint64_t, so bytes are sign-extended if
+    char is signed. Rather than sign-extending, the byte's top bit is flipped
+    and 128 * 23 subtracted from the index, which wraps to the same result --
+    the index must include that bias. The rotate uses variable shifts, and
+    AVX2 shifts of 64 or more yield zero, so a shift of zero leaves the hash
+    unchanged as it does in hash64_at.
+==============================================================================*/
+__attribute__((target("avx2")))
+inline __m256i batch_step(__m256i hash, __m256i words, __m256i shifts,
+                          __m256i index, int byte)
+{
+  const __m256i byte_mask = _mm256_set1_epi64x(0xFF);
+  const __m256i hash_mul  = _mm256_set1_epi64x(5741);
+
+  __m256i curchar = _mm256_and_si256(_mm256_srli_epi64(words, byte * 8), byte_mask);
+  if (char(-1) < 0) {
+    curchar = _mm256_xor_si256(curchar, _mm256_set1_epi64x(0x80));
+  }
+  const __m256i shift = _mm256_and_si256(_mm256_srli_epi64(shifts, byte * 8), byte_mask);
+
+  const __m256i hash_lo = _mm256_mul_epu32(hash, hash_mul);
+  const __m256i hash_hi = _mm256_mul_epu32(_mm256_srli_epi64(hash, 32), hash_mul);
+  hash = _mm256_add_epi64(
+    _mm256_add_epi64(hash_lo, _mm256_slli_epi64(hash_hi, 32)),
+    _mm256_add_epi64(_mm256_mul_epu32(curchar, _mm256_set1_epi64x(23)), index));
+
+  return _mm256_or_si256(
+    _mm256_sllv_epi64(hash, shift),
+    _mm256_srlv_epi64(hash, _mm256_sub_epi64(_mm256_set1_epi64x(64), shift)));
+}
+
+
+
+/*==============================================================================
+  hash64_batch_avx2(keys, lengths, count, out, seed)
+
+    Runs the hash64 loop for eight keys at once, one per 64-bit lane. Each
+    lane is fed a word of its key at a time and the word's bytes are hashed in
+    order. When a lane has less than a word of its key left, the remainder is
+    finished by hash64_at and the lane is refilled with the next key, so keys
+    of different lengths don't hold each other up. Once there aren't enough
+    keys left to fill every lane, the remaining lanes are finished by hash64_at
+    as well.
+==============================================================================*/
+__attribute__((target("avx2")))
+void hash64_batch_avx2(const char *const *keys, const size_t *lengths,
+                       size_t count, uint64_t *out, uint64_t seed)
+{
+  alignas(32) uint64_t lane_hash[BATCH_LANES];
+  alignas(32) uint64_t lane_offset[BATCH_LANES];
+  size_t lane_key[BATCH_LANES];
+  size_t next_key = 0;
+
+  // Pulls the next key that's at least a word long, hashing any shorter keys
+  // on the way. Returns false if there are no keys left.
+  const auto next_lane_key = [&](size_t lane) -> bool {
+    for (; next_key < count; ++next_key) {
+      if (lengths[next_key] >= BATCH_WORD_SIZE) {
+        lane_key[lane] = next_key++;
+        lane_hash[lane] = seed;
+        lane_offset[lane] = 0;
+        return true;
+      }
+      out[next_key] = hash64_at(keys[next_key], lengths[next_key], seed, 0);
+    }
+    return false;
+  };
+
+  size_t lanes_filled = 0;
+  while (lanes_filled < BATCH_LANES && next_lane_key(lanes_filled)) {
+    ++lanes_filled;
+  }
+
+  const __m256i word_step = _mm256_set1_epi64x(BATCH_WORD_SIZE);
+  const int64_t sign_bias = char(-1) < 0 ? 128 * 23 : 0;
+  bool exhausted = lanes_filled < BATCH_LANES;
+  while (!exhausted) {
+    __m256i hash_lo  = _mm256_load_si256((const __m256i *)lane_hash);
+    __m256i hash_hi  = _mm256_load_si256((const __m256i *)(lane_hash + 4));
+    __m256i index_lo = _mm256_sub_epi64(
+      _mm256_load_si256((const __m256i *)lane_offset),
+      _mm256_set1_epi64x(sign_bias - 257));
+    __m256i index_hi = _mm256_sub_epi64(
+      _mm256_load_si256((const __m256i *)(lane_offset + 4)),
+      _mm256_set1_epi64x(sign_bias - 257));
+
+    bool refill = false;
+    while (!refill) {
+      uint64_t words[BATCH_LANES];
+      for (size_t lane = 0; lane < BATCH_LANES; ++lane) {
+        words[lane] = block_load(keys[lane_key[lane]] + lane_offset[lane]);
+      }
+      const __m256i words_lo  = _mm256_loadu_si256((const __m256i *)words);
+      const __m256i words_hi  = _mm256_loadu_si256((const __m256i *)(words + 4));
+      const __m256i shifts_lo = batch_shifts(words_lo);
+      const __m256i shifts_hi = batch_shifts(words_hi);
+
+      for (int byte = 0; byte < int(BATCH_WORD_SIZE); ++byte) {
+        const __m256i byte_index = _mm256_set1_epi64x(byte);
+        hash_lo = batch_step(hash_lo, words_lo, shifts_lo,
+                             _mm256_add_epi64(index_lo, byte_index), byte);
+        hash_hi = batch_step(hash_hi, words_hi, shifts_hi,
+                             _mm256_add_epi64(index_hi, byte_index), byte);
+      }
+
+      index_lo = _mm256_add_epi64(index_lo, word_step);
+      index_hi = _mm256_add_epi64(index_hi, word_step);
+      for (size_t lane = 0; lane < BATCH_LANES; ++lane) {
+        lane_offset[lane] += BATCH_WORD_SIZE;
+        refill |= lengths[lane_key[lane]] - lane_offset[lane] < BATCH_WORD_SIZE;
+      }
+    }
+
+    _mm256_store_si256((__m256i *)lane_hash, hash_lo);
+    _mm256_store_si256((__m256i *)(lane_hash + 4), hash_hi);
+
+    for (size_t lane = 0; lane < BATCH_LANES && !exhausted; ++lane) {
+      const size_t key = lane_key[lane];
+      const size_t consumed = lane_offset[lane];
+      if (lengths[key] - consumed >= BATCH_WORD_SIZE) {
+        continue;
+      }
+
+      out[key] = hash64_at(keys[key] + consumed, lengths[key] - consumed,
+                           lane_hash[lane], consumed);
+
+      if (!next_lane_key(lane)) {
+        // Out of keys: move the last lane into this one so the lanes still in
+        // use are at the front, then finish them below.
+        --lanes_filled;
+        lane_key[lane] = lane_key[lanes_filled];
+        lane_hash[lane] = lane_hash[lanes_filled];
+        lane_offset[lane] = lane_offset[lanes_filled];
+        exhausted = true;
+      }
+    }
+  }
+
+  // Finish any keys still in lanes.
+  for (size_t lane = 0; lane < lanes_filled; ++lane) {
+    const size_t key = lane_key[lane];
+    const size_t consumed = lane_offset[lane];
+    out[key] = hash64_at(keys[key] + consumed, lengths[key] - consumed,
+                         lane_hash[lane], consumed);
+  }
+}
+
+#endif // S_SIMD_DISPATCH
+
+
+} // anonymous namespace
+
+
+
 /*==============================================================================
   hash32(string, seed)
 
@@ -75,24 +581,277 @@ uint64_t hash64(const string &str, uint64_t seed)
 ==============================================================================*/
 uint64_t hash64(const char *str, const size_t length, uint64_t seed)
 {
-  static uint64_t mask_left[16] = {
-    0x0000ULL << 48, 0x8000ULL << 48, 0xC000ULL << 48, 0xE000ULL << 48,
-    0xF000ULL << 48, 0xF800ULL << 48, 0xFC00ULL << 48, 0xFE00ULL << 48,
-    0xFF00ULL << 48, 0xFF80ULL << 48, 0xFFC0ULL << 48, 0xFFE0ULL << 48,
-    0xFFF0ULL << 48, 0xFFF8ULL << 48, 0xFFFCULL << 48, 0xFFFEULL << 48,
+  return hash64_at(str, length, seed, 0);
+}
+
+
+
+/*==============================================================================
+  hash64_block(string, seed)
+
+    Wrapper around hash64_block to simplify using it with snow::string.
+==============================================================================*/
+uint64_t hash64_block(const string &str, uint64_t seed)
+{
+  return hash64_block(str.c_str(), str.size(), seed);
+}
+
+
+
+/*==============================================================================
+  hash64_block(cstring, length, seed)
+
+    Word-at-a-time hash. The seed is run back through the inverse of the
+    finalizer to recover the state it was produced from, so chaining hashes
+    resumes where the previous one left off.
+==============================================================================*/
+uint64_t hash64_block(const char *str, const size_t length, uint64_t seed)
+{
+  uint64_t state = block_unfinish(seed);
+
+  const size_t stripes = length / BLOCK_STRIPE_SIZE;
+  if (stripes) {
+    state = block_stripes(str, stripes, state);
+    str += stripes * BLOCK_STRIPE_SIZE;
+  }
+
+  size_t remaining = length % BLOCK_STRIPE_SIZE;
+  for (; remaining >= BLOCK_WORD_SIZE; remaining -= BLOCK_WORD_SIZE) {
+    state = state * BLOCK_PRIME + block_mix(block_load(str));
+    str += BLOCK_WORD_SIZE;
+  }
+
+  if (remaining) {
+    state = state * BLOCK_PRIME + block_mix(block_load_tail(str, remaining));
+  }
+
+  return block_finish(state);
+}
+
+
+/*==============================================================================
+  hasher64_t
+==============================================================================*/
+hasher64_t::hasher64_t(uint64_t seed)
+  : hash_(seed), length_(0)
+{
+  /* nop */
+}
+
+
+
+void hasher64_t::reset(uint64_t seed)
+{
+  hash_ = seed;
+  length_ = 0;
+}
+
+
+
+hasher64_t &hasher64_t::update(const void *data, size_t length)
+{
+  hash_ = hash64_at((const char *)data, length, hash_, length_);
+  length_ += length;
+  return *this;
+}
+
+
+
+hasher64_t &hasher64_t::update(const string &str)
+{
+  return update(str.data(), size_t(str.size()));
+}
+
+
+
+/*==============================================================================
+  block_hasher64_t
+
+    Only a partial word ever has to be held back between updates, since the
+    block state is the same whether words arrive in stripes or one at a time.
+    Whole stripes are still consumed directly from the caller's data.
+==============================================================================*/
+block_hasher64_t::block_hasher64_t(uint64_t seed)
+  : state_(block_unfinish(seed)), pending_length_(0)
+{
+  /* nop */
+}
+
+
+
+void block_hasher64_t::reset(uint64_t seed)
+{
+  state_ = block_unfinish(seed);
+  pending_length_ = 0;
+}
+
+
+
+block_hasher64_t &block_hasher64_t::update(const void *data, size_t length)
+{
+  const char *str = (const char *)data;
+
+  if (pending_length_) {
+    const size_t needed = BLOCK_WORD_SIZE - pending_length_;
+    if (length < needed) {
+      std::memcpy(pending_ + pending_length_, str, length);
+      pending_length_ += length;
+      return *this;
+    }
+
+    std::memcpy(pending_ + pending_length_, str, needed);
+    state_ = state_ * BLOCK_PRIME + block_mix(block_load(pending_));
+    pending_length_ = 0;
+    str += needed;
+    length -= needed;
+  }
+
+  const size_t stripes = length / BLOCK_STRIPE_SIZE;
+  if (stripes) {
+    state_ = block_stripes(str, stripes, state_);
+    str += stripes * BLOCK_STRIPE_SIZE;
+    length -= stripes * BLOCK_STRIPE_SIZE;
+  }
+
+  for (; length >= BLOCK_WORD_SIZE; length -= BLOCK_WORD_SIZE) {
+    state_ = state_ * BLOCK_PRIME + block_mix(block_load(str));
+    str += BLOCK_WORD_SIZE;
+  }
+
+  std::memcpy(pending_, str, length);
+  pending_length_ = length;
+  return *this;
+}
+
+
+
+block_hasher64_t &block_hasher64_t::update(const string &str)
+{
+  return update(str.data(), size_t(str.size()));
+}
+
+
+
+uint64_t block_hasher64_t::finish() const
+{
+  uint64_t state = state_;
+  if (pending_length_) {
+    state = state * BLOCK_PRIME + block_mix(block_load_tail(pending_, pending_length_));
+  }
+  return block_finish(state);
+}
+
+
+/*==============================================================================
+  hash64_parallel(string, seed, thread_count)
+
+    Wrapper around hash64_parallel to simplify using it with snow::string.
+==============================================================================*/
+uint64_t hash64_parallel(const string &str, uint64_t seed, unsigned thread_count)
+{
+  return hash64_parallel(str.c_str(), size_t(str.size()), seed, thread_count);
+}
+
+
+
+/*==============================================================================
+  hash64_parallel(cstring, length, seed, thread_count)
+
+    Leaves are handed out to threads through an atomic counter, so the work
+    balances itself, and each leaf's hash is written to its own slot. The tree
+    is then folded on the calling thread -- there's only one node per leaf, so
+    it's cheap next to hashing the leaves.
+==============================================================================*/
+uint64_t hash64_parallel(const char *str, const size_t length, uint64_t seed,
+                         unsigned thread_count)
+{
+  const size_t leaf_count =
+    length == 0 ? 1 : (length + HASH_PARALLEL_LEAF_SIZE - 1) / HASH_PARALLEL_LEAF_SIZE;
+  std::vector<uint64_t> nodes(leaf_count);
+  std::atomic<size_t> next_leaf { 0 };
+
+  const auto hash_leaves = [&] {
+    size_t leaf;
+    while ((leaf = next_leaf.fetch_add(1, std::memory_order_relaxed)) < leaf_count) {
+      const size_t offset = leaf * HASH_PARALLEL_LEAF_SIZE;
+      const size_t leaf_length = std::min(length - offset, HASH_PARALLEL_LEAF_SIZE);
+      nodes[leaf] = hash64_block(str + offset, leaf_length, seed);
+    }
   };
-  uint64_t hash = seed;
-  constexpr uint64_t hbits = sizeof(hash) * 8;
-  uint64_t index = 0;
-  for (; index < length; ++index) {
-    const uint64_t curchar = str[index];
-    hash = hash * 5741U + curchar * 23U + (index + 257U);
-    const uint64_t shift =
-      ((curchar & 0x9) | ((curchar & 0x10) >> 2) | ((curchar & 0x40) >> 5)) ^
-      ((curchar & 0xA) >> 5) | ((curchar & 0x2) << 2) | ((curchar & 0x4) >> 1);
-    hash = (hash << shift) | (hash & mask_left[shift]) >> (hbits - shift);
+
+  if (thread_count == 0) {
+    thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+  if (thread_count > leaf_count) {
+    thread_count = unsigned(leaf_count);
+  }
+
+  std::vector<std::thread> threads;
+#if USE_EXCEPTIONS
+  try {
+#endif
+    threads.reserve(thread_count - 1);
+    for (unsigned index = 1; index < thread_count; ++index) {
+      threads.emplace_back(hash_leaves);
+    }
+#if USE_EXCEPTIONS
+  } catch (const std::exception &) {
+    // Leaves are taken from the counter, so whichever threads did start
+    // still hash all of them along with this one
+  }
+#endif
+  hash_leaves();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  // Fold each level into the next by hashing pairs of nodes. An unpaired node
+  // at the end of a level moves up unchanged. Inner nodes use a different seed
+  // than leaves so that a node can't be passed off as a leaf's data.
+  const uint64_t node_seed = seed ^ PARALLEL_NODE_KEY;
+  char pair[16];
+  size_t level_count = leaf_count;
+  while (level_count > 1) {
+    size_t out = 0;
+    for (size_t index = 0; index + 1 < level_count; index += 2) {
+      parallel_store(pair, nodes[index]);
+      parallel_store(pair + 8, nodes[index + 1]);
+      nodes[out++] = hash64_block(pair, sizeof(pair), node_seed);
+    }
+    if (level_count & 1) {
+      nodes[out++] = nodes[level_count - 1];
+    }
+    level_count = out;
+  }
+
+  // The root is hashed with the input length, so inputs whose trees have the
+  // same shape but different lengths differ.
+  parallel_store(pair, nodes[0]);
+  parallel_store(pair + 8, uint64_t(length));
+  return hash64_block(pair, sizeof(pair), seed ^ PARALLEL_ROOT_KEY);
+}
+
+
+
+/*==============================================================================
+  hash64_batch(keys, lengths, count, out, seed)
+
+    Hashes several keys at once. Falls back to calling hash64_at per key when
+    there's no AVX2 or too few keys to fill its lanes.
+==============================================================================*/
+void hash64_batch(const char *const *keys, const size_t *lengths, size_t count,
+                  uint64_t *out, uint64_t seed)
+{
+#if S_SIMD_DISPATCH
+  if (count >= BATCH_LANES && cpu_has_avx2()) {
+    hash64_batch_avx2(keys, lengths, count, out, seed);
+    return;
+  }
+#endif
+
+  for (size_t index = 0; index < count; ++index) {
+    out[index] = hash64_at(keys[index], lengths[index], seed, 0);
   }
-  return hash;
 }
 
 
@@ -0,0 +1,183 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#include "snow/data/mapped_file.hh"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace snow {
+
+/// Static function declarations
+namespace {
+
+// Formats an error for a failed call on a path using errno.
+string path_error(const char *what, const char *path);
+// Reads all of fd into buffer. Returns false and sets errno on failure.
+bool read_all(int fd, std::vector<char> &buffer);
+
+
+
+/// Constants
+
+const size_t MF_READ_CHUNK_SIZE = 64 * 1024;
+
+
+
+/// Static function definitions
+
+string path_error(const char *what, const char *path)
+{
+  string error(what);
+  error.append(" '").append(path).append("': ").append(std::strerror(errno));
+  return error;
+}
+
+bool read_all(int fd, std::vector<char> &buffer)
+{
+  size_t length = 0;
+  for (;;) {
+    buffer.resize(length + MF_READ_CHUNK_SIZE);
+    const ssize_t count = ::read(fd, buffer.data() + length, MF_READ_CHUNK_SIZE);
+    if (count < 0) {
+      if (errno == EINTR)
+        continue;
+      buffer.clear();
+      return false;
+    } else if (count == 0) {
+      break;
+    }
+    length += size_t(count);
+  }
+  buffer.resize(length);
+  return true;
+}
+
+} // anonymous namespace
+
+
+
+/// mapped_file_t
+
+mapped_file_t::mapped_file_t(const char *path, access_hint_t hint)
+{
+  if (!open(path, hint)) {
+    s_throw(std::runtime_error, "%s", error_.c_str());
+  }
+}
+
+mapped_file_t::mapped_file_t(mapped_file_t &&other) :
+  data_(other.data_), size_(other.size_), open_(other.open_),
+  mapped_(other.mapped_), buffer_(std::move(other.buffer_)),
+  error_(std::move(other.error_))
+{
+  other.data_ = nullptr;
+  other.size_ = 0;
+  other.open_ = false;
+  other.mapped_ = false;
+}
+
+mapped_file_t::~mapped_file_t()
+{
+  close();
+}
+
+mapped_file_t &mapped_file_t::operator = (mapped_file_t &&other)
+{
+  if (this != &other) {
+    close();
+    data_ = other.data_;
+    size_ = other.size_;
+    open_ = other.open_;
+    mapped_ = other.mapped_;
+    buffer_ = std::move(other.buffer_);
+    error_ = std::move(other.error_);
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.open_ = false;
+    other.mapped_ = false;
+  }
+  return *this;
+}
+
+bool mapped_file_t::open(const char *path, access_hint_t hint)
+{
+  close();
+  error_.clear();
+
+  const int fd = ::open(path, O_RDONLY);
+  if (fd == -1) {
+    error_ = path_error("Unable to open", path);
+    return false;
+  }
+
+  struct stat info;
+  if (::fstat(fd, &info) == -1) {
+    error_ = path_error("Unable to stat", path);
+    ::close(fd);
+    return false;
+  }
+
+  if (S_ISREG(info.st_mode) && info.st_size > 0) {
+    const size_t size = size_t(info.st_size);
+    void *const mapping = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (mapping != MAP_FAILED) {
+      int advice = POSIX_MADV_NORMAL;
+      switch (hint) {
+      case ACCESS_SEQUENTIAL: advice = POSIX_MADV_SEQUENTIAL; break;
+      case ACCESS_RANDOM:     advice = POSIX_MADV_RANDOM; break;
+      default: break;
+      }
+      // Only advice, so failure doesn't matter
+      ::posix_madvise(mapping, size, advice);
+
+      data_ = (const char *)mapping;
+      size_ = size;
+      mapped_ = true;
+      open_ = true;
+      // The mapping stays valid once the descriptor is closed
+      ::close(fd);
+      return true;
+    }
+  }
+
+  // Empty or unmappable, so read whatever's there
+  if (!read_all(fd, buffer_)) {
+    error_ = path_error("Unable to read", path);
+    ::close(fd);
+    return false;
+  }
+
+  ::close(fd);
+  data_ = buffer_.empty() ? nullptr : buffer_.data();
+  size_ = buffer_.size();
+  open_ = true;
+  return true;
+}
+
+void mapped_file_t::close()
+{
+  if (mapped_) {
+    ::munmap((void *)data_, size_);
+  }
+  buffer_.clear();
+  buffer_.shrink_to_fit();
+  data_ = nullptr;
+  size_ = 0;
+  open_ = false;
+  mapped_ = false;
+}
+
+
+} // namespace snow
@@ -0,0 +1,938 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#include <snow/data/sketch.hh>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+
+
+namespace snow {
+
+
+namespace {
+
+
+/// Hashing
+
+/*==============================================================================
+  sketch_mix(hash)
+
+    MurmurHash3's 64-bit finalizer. hash64 doesn't spread small changes in its
+    input across all of its output bits well enough for sketches, which take
+    their bucket and register indices directly from the hash, so every hash is
+    mixed through this first. It's a bijection, so it adds no collisions.
+==============================================================================*/
+inline uint64_t sketch_mix(uint64_t hash)
+{
+  hash ^= hash >> 33;
+  hash *= 0xFF51AFD7ED558CCDULL;
+  hash ^= hash >> 33;
+  hash *= 0xC4CEB9FE1A85EC53ULL;
+  hash ^= hash >> 33;
+  return hash;
+}
+
+
+
+// Key mixed into a hash to derive a second, independent hash from it.
+const uint64_t SKETCH_SECOND_KEY = 0x9E3779B97F4A7C15ULL;
+
+
+
+/*==============================================================================
+  sketch_range(hash, range)
+
+    Maps the top 32 bits of a hash onto [0, range) without division. Range
+    must be less than 2^32.
+==============================================================================*/
+inline size_t sketch_range(uint64_t hash, size_t range)
+{
+  return size_t(((hash >> 32) * uint64_t(range)) >> 32);
+}
+
+
+
+/// Serialization
+
+const uint32_t SKETCH_VERSION = 1;
+
+const uint32_t BLOOM_MAGIC       = 0x4D4F4C42U; // 'BLOM'
+const uint32_t CUCKOO_MAGIC      = 0x4B435543U; // 'CUCK'
+const uint32_t COUNT_MIN_MAGIC   = 0x534E4D43U; // 'CMNS'
+const uint32_t HYPERLOGLOG_MAGIC = 0x4C4C5948U; // 'HYLL'
+
+
+
+// Written before every sketch's data. Params are specific to each sketch.
+struct sketch_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint64_t seed;
+  uint64_t params[2];
+};
+
+
+
+/*==============================================================================
+  write_sketch(out, header, data, length)
+
+    Writes a header followed by length bytes of data, provided the stream has
+    room for all of it. Returns the number of bytes written.
+==============================================================================*/
+size_t write_sketch(buffer_stream_t &out, const sketch_header_t &header,
+                    const void *data, size_t length)
+{
+  const size_t total = sizeof(header) + length;
+  if (out.remainder() < total) {
+    return 0;
+  }
+  out.write(header);
+  out.write(data, length);
+  return total;
+}
+
+
+
+/*==============================================================================
+  peek_header(in, magic, header)
+
+    Copies the header at the stream's current position without advancing the
+    stream. Returns false if there's no header or it's not of the given kind.
+==============================================================================*/
+bool peek_header(const buffer_stream_t &in, uint32_t magic,
+                 sketch_header_t &header)
+{
+  if (in.remainder() < sizeof(header)) {
+    return false;
+  }
+  std::memcpy(&header, in.pointer(), sizeof(header));
+  return header.magic == magic && header.version == SKETCH_VERSION;
+}
+
+
+
+/*==============================================================================
+  read_sketch(in, data, length)
+
+    Reads length bytes of data following the header at the stream's current
+    position, provided the stream contains all of it.
+==============================================================================*/
+bool read_sketch(const buffer_stream_t &in, void *data, size_t length)
+{
+  if (in.remainder() < sizeof(sketch_header_t) + length) {
+    return false;
+  }
+  in.skip(sizeof(sketch_header_t));
+  in.read(data, length);
+  return true;
+}
+
+
+
+/*==============================================================================
+  check_merge(same_shape, seed, other_seed, kind)
+
+    Throws if two sketches can't be merged.
+==============================================================================*/
+void check_merge(bool same_shape, uint64_t seed, uint64_t other_seed,
+                 const char *kind)
+{
+  if (!same_shape || seed != other_seed) {
+    s_throw(std::invalid_argument,
+            "Cannot merge %s with different parameters or seed", kind);
+  }
+}
+
+
+
+/// Bloom filter constants
+
+const size_t BLOOM_WORDS_PER_BLOCK = bloom_filter_t::BLOCK_SIZE / sizeof(uint64_t);
+// Number of bits needed to index a bit in a block.
+const unsigned BLOOM_BLOCK_SHIFT = 9;
+const unsigned BLOOM_MAX_HASHES = 16;
+
+static_assert((size_t(1) << BLOOM_BLOCK_SHIFT) == bloom_filter_t::BLOCK_SIZE * 8,
+              "BLOOM_BLOCK_SHIFT must index a bit in a block");
+
+
+
+/// Cuckoo filter constants
+
+// Maximum number of fingerprints evicted to place one new fingerprint.
+const size_t CUCKOO_MAX_KICKS = 500;
+// Occupancy the filter is sized for.
+const double CUCKOO_LOAD_FACTOR = 0.95;
+
+
+} // namespace <anon>
+
+
+
+/*==============================================================================
+  bloom_filter_t(expected_items, false_positive_rate, seed)
+
+    Sizes the filter as a standard Bloom filter would be sized: m = -n ln(p) /
+    ln(2)^2 bits and k = m/n ln(2) hashes.
+==============================================================================*/
+bloom_filter_t::bloom_filter_t(size_t expected_items, double false_positive_rate,
+                               uint64_t seed) :
+  block_count_(1),
+  hash_count_(1),
+  seed_(seed)
+{
+  if (!(false_positive_rate > 0 && false_positive_rate < 1)) {
+    s_throw(std::invalid_argument, "False positive rate must be in (0, 1)");
+  }
+
+  const double items = double(std::max(expected_items, size_t(1)));
+  const double ln2 = std::log(2.0);
+  const double bits = -items * std::log(false_positive_rate) / (ln2 * ln2);
+  const double block_bits = double(BLOCK_SIZE * 8);
+
+  block_count_ = size_t(std::min(std::ceil(bits / block_bits), double(UINT32_MAX)));
+  block_count_ = std::max(block_count_, size_t(1));
+  const double hashes = std::round(bits / items * ln2);
+  hash_count_ = unsigned(std::max(1.0, std::min(hashes, double(BLOOM_MAX_HASHES))));
+  blocks_ = allocate_blocks(block_count_);
+}
+
+
+
+bloom_filter_t::bloom_filter_t(size_t block_count, unsigned hash_count,
+                               uint64_t seed) :
+  block_count_(block_count),
+  hash_count_(hash_count),
+  seed_(seed),
+  blocks_(allocate_blocks(block_count))
+{
+  /* nop */
+}
+
+
+
+bloom_filter_t::bloom_filter_t(const bloom_filter_t &other) :
+  bloom_filter_t(other.block_count_, other.hash_count_, other.seed_)
+{
+  std::memcpy(blocks_.get(), other.blocks_.get(), block_count_ * BLOCK_SIZE);
+}
+
+
+
+bloom_filter_t &bloom_filter_t::operator = (const bloom_filter_t &other)
+{
+  if (&other != this) {
+    if (block_count_ != other.block_count_ || !blocks_) {
+      blocks_ = allocate_blocks(other.block_count_);
+    }
+    block_count_ = other.block_count_;
+    hash_count_ = other.hash_count_;
+    seed_ = other.seed_;
+    std::memcpy(blocks_.get(), other.blocks_.get(), block_count_ * BLOCK_SIZE);
+  }
+  return *this;
+}
+
+
+
+/*==============================================================================
+  allocate_blocks(block_count)
+
+    Allocates zeroed, cache-line aligned blocks.
+==============================================================================*/
+auto bloom_filter_t::allocate_blocks(size_t block_count) -> blocks_t
+{
+  block_allocator_t allocator;
+  blocks_t blocks((uint64_t *)allocator.allocate(block_count * BLOCK_SIZE),
+                  allocator.deallocator());
+  std::memset(blocks.get(), 0, block_count * BLOCK_SIZE);
+  return blocks;
+}
+
+
+
+void bloom_filter_t::add(const char *str, size_t length)
+{
+  add_hash(hash64(str, length, seed_));
+}
+
+
+
+void bloom_filter_t::add(const string &str)
+{
+  add_hash(hash64(str, seed_));
+}
+
+
+
+/*==============================================================================
+  add_hash(hash)
+
+    The top 32 bits of the hash pick the block. Bits within the block are
+    picked by double hashing from the low 32 bits and a second hash, taking
+    the top 9 bits of each step.
+==============================================================================*/
+void bloom_filter_t::add_hash(uint64_t hash)
+{
+  hash = sketch_mix(hash);
+  uint64_t *const block = blocks_.get() + sketch_range(hash, block_count_) * BLOOM_WORDS_PER_BLOCK;
+  uint32_t bit = uint32_t(hash);
+  const uint32_t step = uint32_t(sketch_mix(hash ^ SKETCH_SECOND_KEY)) | 1;
+  for (unsigned index = 0; index < hash_count_; ++index, bit += step) {
+    const uint32_t position = bit >> (32 - BLOOM_BLOCK_SHIFT);
+    block[position / 64] |= uint64_t(1) << (position % 64);
+  }
+}
+
+
+
+bool bloom_filter_t::contains(const char *str, size_t length) const
+{
+  return contains_hash(hash64(str, length, seed_));
+}
+
+
+
+bool bloom_filter_t::contains(const string &str) const
+{
+  return contains_hash(hash64(str, seed_));
+}
+
+
+
+bool bloom_filter_t::contains_hash(uint64_t hash) const
+{
+  hash = sketch_mix(hash);
+  const uint64_t *const block = blocks_.get() + sketch_range(hash, block_count_) * BLOOM_WORDS_PER_BLOCK;
+  uint32_t bit = uint32_t(hash);
+  const uint32_t step = uint32_t(sketch_mix(hash ^ SKETCH_SECOND_KEY)) | 1;
+  for (unsigned index = 0; index < hash_count_; ++index, bit += step) {
+    const uint32_t position = bit >> (32 - BLOOM_BLOCK_SHIFT);
+    if (!(block[position / 64] & (uint64_t(1) << (position % 64)))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+
+void bloom_filter_t::clear()
+{
+  std::memset(blocks_.get(), 0, block_count_ * BLOCK_SIZE);
+}
+
+
+
+void bloom_filter_t::merge(const bloom_filter_t &other)
+{
+  check_merge(block_count_ == other.block_count_ &&
+              hash_count_ == other.hash_count_,
+              seed_, other.seed_, "bloom_filter_t");
+  const size_t word_count = block_count_ * BLOOM_WORDS_PER_BLOCK;
+  uint64_t *const words = blocks_.get();
+  const uint64_t *const other_words = other.blocks_.get();
+  for (size_t index = 0; index < word_count; ++index) {
+    words[index] |= other_words[index];
+  }
+}
+
+
+
+size_t bloom_filter_t::serialized_size() const
+{
+  return sizeof(sketch_header_t) + block_count_ * BLOCK_SIZE;
+}
+
+
+
+size_t bloom_filter_t::serialize(buffer_stream_t &out) const
+{
+  const sketch_header_t header {
+    BLOOM_MAGIC, SKETCH_VERSION, seed_, { block_count_, hash_count_ }
+  };
+  return write_sketch(out, header, blocks_.get(), block_count_ * BLOCK_SIZE);
+}
+
+
+
+bool bloom_filter_t::deserialize(const buffer_stream_t &in)
+{
+  sketch_header_t header;
+  if (!peek_header(in, BLOOM_MAGIC, header) ||
+      header.params[0] == 0 || header.params[0] > UINT32_MAX ||
+      header.params[1] == 0 || header.params[1] > BLOOM_MAX_HASHES ||
+      in.remainder() - sizeof(header) < header.params[0] * BLOCK_SIZE) {
+    return false;
+  }
+
+  bloom_filter_t result(size_t(header.params[0]), unsigned(header.params[1]),
+                        header.seed);
+  read_sketch(in, result.blocks_.get(), result.block_count_ * BLOCK_SIZE);
+  *this = std::move(result);
+  return true;
+}
+
+
+
+/*==============================================================================
+  cuckoo_filter_t(capacity, seed)
+
+    Rounds the bucket count up to a power of two so that a fingerprint's
+    alternate bucket can be found by xor.
+==============================================================================*/
+cuckoo_filter_t::cuckoo_filter_t(size_t capacity, uint64_t seed) :
+  seed_(seed),
+  size_(0),
+  kick_state_(seed)
+{
+  const size_t wanted = size_t(std::ceil(double(capacity) /
+                                         (BUCKET_SIZE * CUCKOO_LOAD_FACTOR)));
+  size_t bucket_count = 1;
+  while (bucket_count < wanted) {
+    bucket_count <<= 1;
+  }
+  buckets_.resize(bucket_count * BUCKET_SIZE, 0);
+}
+
+
+
+/*==============================================================================
+  alt_bucket(bucket, fingerprint)
+
+    Returns the other bucket a fingerprint may be stored in. This is its own
+    inverse, so it works from either bucket.
+==============================================================================*/
+size_t cuckoo_filter_t::alt_bucket(size_t bucket, uint16_t fingerprint) const
+{
+  return (bucket ^ size_t(sketch_mix(fingerprint))) & (bucket_count() - 1);
+}
+
+
+
+/*==============================================================================
+  insert(bucket, fingerprint)
+
+    Stores a fingerprint in either of its buckets, evicting fingerprints to
+    their alternate buckets to make room if both are full. Each eviction is
+    recorded so that, if no room is found, they can be undone.
+==============================================================================*/
+bool cuckoo_filter_t::insert(size_t bucket, uint16_t fingerprint)
+{
+  const size_t buckets[2] = { bucket, alt_bucket(bucket, fingerprint) };
+  for (size_t candidate : buckets) {
+    uint16_t *const slots = &buckets_[candidate * BUCKET_SIZE];
+    for (size_t slot = 0; slot < BUCKET_SIZE; ++slot) {
+      if (slots[slot] == 0) {
+        slots[slot] = fingerprint;
+        ++size_;
+        return true;
+      }
+    }
+  }
+
+  struct kick_t { size_t index; uint16_t fingerprint; };
+  kick_t kicks[CUCKOO_MAX_KICKS];
+
+  for (size_t kick = 0; kick < CUCKOO_MAX_KICKS; ++kick) {
+    // xorshift64 -- only needs to avoid evicting in a cycle.
+    kick_state_ ^= kick_state_ << 13;
+    kick_state_ ^= kick_state_ >> 7;
+    kick_state_ ^= kick_state_ << 17;
+    if (kick == 0) {
+      bucket = buckets[kick_state_ & 1];
+    }
+
+    const size_t index = bucket * BUCKET_SIZE + size_t(kick_state_ >> 32) % BUCKET_SIZE;
+    kicks[kick] = { index, buckets_[index] };
+    std::swap(fingerprint, buckets_[index]);
+
+    bucket = alt_bucket(bucket, fingerprint);
+    uint16_t *const slots = &buckets_[bucket * BUCKET_SIZE];
+    for (size_t slot = 0; slot < BUCKET_SIZE; ++slot) {
+      if (slots[slot] == 0) {
+        slots[slot] = fingerprint;
+        ++size_;
+        return true;
+      }
+    }
+  }
+
+  for (size_t kick = CUCKOO_MAX_KICKS; kick-- > 0;) {
+    buckets_[kicks[kick].index] = kicks[kick].fingerprint;
+  }
+  return false;
+}
+
+
+
+bool cuckoo_filter_t::add(const char *str, size_t length)
+{
+  return add_hash(hash64(str, length, seed_));
+}
+
+
+
+bool cuckoo_filter_t::add(const string &str)
+{
+  return add_hash(hash64(str, seed_));
+}
+
+
+
+/*==============================================================================
+  add_hash(hash)
+
+    The fingerprint is the low 16 bits of the hash, with zero (an empty slot)
+    mapped to one. The bucket comes from the top bits.
+==============================================================================*/
+bool cuckoo_filter_t::add_hash(uint64_t hash)
+{
+  hash = sketch_mix(hash);
+  const uint16_t fingerprint = std::max(uint16_t(hash), uint16_t(1));
+  return insert(size_t(hash >> 32) & (bucket_count() - 1), fingerprint);
+}
+
+
+
+bool cuckoo_filter_t::remove(const char *str, size_t length)
+{
+  return remove_hash(hash64(str, length, seed_));
+}
+
+
+
+bool cuckoo_filter_t::remove(const string &str)
+{
+  return remove_hash(hash64(str, seed_));
+}
+
+
+
+bool cuckoo_filter_t::remove_hash(uint64_t hash)
+{
+  hash = sketch_mix(hash);
+  const uint16_t fingerprint = std::max(uint16_t(hash), uint16_t(1));
+  const size_t bucket = size_t(hash >> 32) & (bucket_count() - 1);
+  for (size_t candidate : { bucket, alt_bucket(bucket, fingerprint) }) {
+    uint16_t *const slots = &buckets_[candidate * BUCKET_SIZE];
+    for (size_t slot = 0; slot < BUCKET_SIZE; ++slot) {
+      if (slots[slot] == fingerprint) {
+        slots[slot] = 0;
+        --size_;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+
+bool cuckoo_filter_t::contains(const char *str, size_t length) const
+{
+  return contains_hash(hash64(str, length, seed_));
+}
+
+
+
+bool cuckoo_filter_t::contains(const string &str) const
+{
+  return contains_hash(hash64(str, seed_));
+}
+
+
+
+bool cuckoo_filter_t::contains_hash(uint64_t hash) const
+{
+  hash = sketch_mix(hash);
+  const uint16_t fingerprint = std::max(uint16_t(hash), uint16_t(1));
+  const size_t bucket = size_t(hash >> 32) & (bucket_count() - 1);
+  for (size_t candidate : { bucket, alt_bucket(bucket, fingerprint) }) {
+    const uint16_t *const slots = &buckets_[candidate * BUCKET_SIZE];
+    for (size_t slot = 0; slot < BUCKET_SIZE; ++slot) {
+      if (slots[slot] == fingerprint) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+
+void cuckoo_filter_t::clear()
+{
+  std::fill(buckets_.begin(), buckets_.end(), uint16_t(0));
+  size_ = 0;
+}
+
+
+
+/*==============================================================================
+  merge(other)
+
+    Fingerprints can't be turned back into keys, but a fingerprint and either
+    of its buckets are enough to insert it, so each of other's fingerprints is
+    inserted starting from the bucket it's in.
+==============================================================================*/
+bool cuckoo_filter_t::merge(const cuckoo_filter_t &other)
+{
+  check_merge(buckets_.size() == other.buckets_.size(), seed_, other.seed_,
+              "cuckoo_filter_t");
+  for (size_t index = 0; index < other.buckets_.size(); ++index) {
+    const uint16_t fingerprint = other.buckets_[index];
+    if (fingerprint != 0 && !insert(index / BUCKET_SIZE, fingerprint)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+
+size_t cuckoo_filter_t::serialized_size() const
+{
+  return sizeof(sketch_header_t) + buckets_.size() * sizeof(uint16_t);
+}
+
+
+
+size_t cuckoo_filter_t::serialize(buffer_stream_t &out) const
+{
+  const sketch_header_t header {
+    CUCKOO_MAGIC, SKETCH_VERSION, seed_, { bucket_count(), size_ }
+  };
+  return write_sketch(out, header, buckets_.data(),
+                      buckets_.size() * sizeof(uint16_t));
+}
+
+
+
+bool cuckoo_filter_t::deserialize(const buffer_stream_t &in)
+{
+  sketch_header_t header;
+  if (!peek_header(in, CUCKOO_MAGIC, header) ||
+      (header.params[0] & (header.params[0] - 1)) != 0 ||
+      header.params[0] == 0 ||
+      header.params[1] > header.params[0] * BUCKET_SIZE ||
+      (in.remainder() - sizeof(header)) / (BUCKET_SIZE * sizeof(uint16_t)) <
+        header.params[0]) {
+    return false;
+  }
+
+  std::vector<uint16_t> buckets(size_t(header.params[0]) * BUCKET_SIZE);
+  read_sketch(in, buckets.data(), buckets.size() * sizeof(uint16_t));
+  seed_ = header.seed;
+  size_ = size_t(header.params[1]);
+  kick_state_ = header.seed;
+  buckets_ = std::move(buckets);
+  return true;
+}
+
+
+
+/*==============================================================================
+  count_min_sketch_t(epsilon, delta, seed)
+
+    Width is e / epsilon and depth is ln(1 / delta), per Cormode and
+    Muthukrishnan.
+==============================================================================*/
+count_min_sketch_t::count_min_sketch_t(double epsilon, double delta,
+                                       uint64_t seed) :
+  width_(1),
+  depth_(1),
+  seed_(seed),
+  total_(0)
+{
+  if (!(epsilon > 0 && epsilon < 1) || !(delta > 0 && delta < 1)) {
+    s_throw(std::invalid_argument, "Epsilon and delta must be in (0, 1)");
+  }
+
+  width_ = size_t(std::min(std::ceil(std::exp(1.0) / epsilon), double(UINT32_MAX)));
+  depth_ = std::max(size_t(std::ceil(std::log(1.0 / delta))), size_t(1));
+  counters_.resize(width_ * depth_, 0);
+}
+
+
+
+void count_min_sketch_t::add(const char *str, size_t length, uint32_t count)
+{
+  add_hash(hash64(str, length, seed_), count);
+}
+
+
+
+void count_min_sketch_t::add(const string &str, uint32_t count)
+{
+  add_hash(hash64(str, seed_), count);
+}
+
+
+
+/*==============================================================================
+  add_hash(hash, count)
+
+    Each row's column is picked by double hashing (h1 + row * h2), which is as
+    good as independent hashes per row for a count-min sketch.
+==============================================================================*/
+void count_min_sketch_t::add_hash(uint64_t hash, uint32_t count)
+{
+  uint64_t column = sketch_mix(hash);
+  const uint64_t step = sketch_mix(column ^ SKETCH_SECOND_KEY) | 1;
+  uint32_t *row = counters_.data();
+  for (size_t index = 0; index < depth_; ++index, column += step, row += width_) {
+    uint32_t &counter = row[sketch_range(column, width_)];
+    counter = counter > UINT32_MAX - count ? UINT32_MAX : counter + count;
+  }
+  total_ += count;
+}
+
+
+
+uint32_t count_min_sketch_t::estimate(const char *str, size_t length) const
+{
+  return estimate_hash(hash64(str, length, seed_));
+}
+
+
+
+uint32_t count_min_sketch_t::estimate(const string &str) const
+{
+  return estimate_hash(hash64(str, seed_));
+}
+
+
+
+uint32_t count_min_sketch_t::estimate_hash(uint64_t hash) const
+{
+  uint64_t column = sketch_mix(hash);
+  const uint64_t step = sketch_mix(column ^ SKETCH_SECOND_KEY) | 1;
+  const uint32_t *row = counters_.data();
+  uint32_t result = UINT32_MAX;
+  for (size_t index = 0; index < depth_; ++index, column += step, row += width_) {
+    result = std::min(result, row[sketch_range(column, width_)]);
+  }
+  return result;
+}
+
+
+
+void count_min_sketch_t::clear()
+{
+  std::fill(counters_.begin(), counters_.end(), 0U);
+  total_ = 0;
+}
+
+
+
+void count_min_sketch_t::merge(const count_min_sketch_t &other)
+{
+  check_merge(width_ == other.width_ && depth_ == other.depth_, seed_,
+              other.seed_, "count_min_sketch_t");
+  for (size_t index = 0; index < counters_.size(); ++index) {
+    const uint32_t count = other.counters_[index];
+    uint32_t &counter = counters_[index];
+    counter = counter > UINT32_MAX - count ? UINT32_MAX : counter + count;
+  }
+  total_ += other.total_;
+}
+
+
+
+size_t count_min_sketch_t::serialized_size() const
+{
+  return sizeof(sketch_header_t) + sizeof(total_) +
+         counters_.size() * sizeof(uint32_t);
+}
+
+
+
+size_t count_min_sketch_t::serialize(buffer_stream_t &out) const
+{
+  // The total is stored as the first word of the data rather than in the
+  // header, which only has room for the dimensions.
+  std::vector<char> data(sizeof(total_) + counters_.size() * sizeof(uint32_t));
+  std::memcpy(data.data(), &total_, sizeof(total_));
+  std::memcpy(data.data() + sizeof(total_), counters_.data(),
+              counters_.size() * sizeof(uint32_t));
+
+  const sketch_header_t header {
+    COUNT_MIN_MAGIC, SKETCH_VERSION, seed_, { width_, depth_ }
+  };
+  return write_sketch(out, header, data.data(), data.size());
+}
+
+
+
+bool count_min_sketch_t::deserialize(const buffer_stream_t &in)
+{
+  sketch_header_t header;
+  if (!peek_header(in, COUNT_MIN_MAGIC, header) ||
+      header.params[0] == 0 || header.params[0] > UINT32_MAX ||
+      header.params[1] == 0 || header.params[1] > UINT32_MAX ||
+      in.remainder() - sizeof(header) < sizeof(total_) ||
+      (in.remainder() - sizeof(header) - sizeof(total_)) / sizeof(uint32_t) /
+        header.params[0] < header.params[1]) {
+    return false;
+  }
+
+  const size_t counter_count = size_t(header.params[0] * header.params[1]);
+  std::vector<char> data(sizeof(total_) + counter_count * sizeof(uint32_t));
+  read_sketch(in, data.data(), data.size());
+
+  width_ = size_t(header.params[0]);
+  depth_ = size_t(header.params[1]);
+  seed_ = header.seed;
+  std::memcpy(&total_, data.data(), sizeof(total_));
+  counters_.resize(counter_count);
+  std::memcpy(counters_.data(), data.data() + sizeof(total_),
+              counter_count * sizeof(uint32_t));
+  return true;
+}
+
+
+
+hyperloglog_t::hyperloglog_t(unsigned precision, uint64_t seed) :
+  precision_(precision),
+  seed_(seed)
+{
+  if (precision < MIN_PRECISION || precision > MAX_PRECISION) {
+    s_throw(std::invalid_argument, "HyperLogLog precision must be in [%u, %u]",
+            MIN_PRECISION, MAX_PRECISION);
+  }
+  registers_.resize(size_t(1) << precision, 0);
+}
+
+
+
+void hyperloglog_t::add(const char *str, size_t length)
+{
+  add_hash(hash64(str, length, seed_));
+}
+
+
+
+void hyperloglog_t::add(const string &str)
+{
+  add_hash(hash64(str, seed_));
+}
+
+
+
+/*==============================================================================
+  add_hash(hash)
+
+    The top precision bits pick a register, which keeps the largest rank (the
+    position of the first set bit) seen in the remaining bits. A bit is set
+    below the remaining bits so that the rank is bounded.
+==============================================================================*/
+void hyperloglog_t::add_hash(uint64_t hash)
+{
+  hash = sketch_mix(hash);
+  const size_t index = size_t(hash >> (64 - precision_));
+  const uint64_t rest = (hash << precision_) | (uint64_t(1) << (precision_ - 1));
+  const uint8_t rank = uint8_t(__builtin_clzll(rest) + 1);
+  registers_[index] = std::max(registers_[index], rank);
+}
+
+
+
+/*==============================================================================
+  estimate()
+
+    The raw HyperLogLog estimate, falling back to linear counting for small
+    cardinalities where the raw estimate is biased (Flajolet et al., 2007).
+    64-bit hashes don't need the large-range correction.
+==============================================================================*/
+double hyperloglog_t::estimate() const
+{
+  const double count = double(registers_.size());
+  double sum = 0;
+  size_t zeroes = 0;
+  for (const uint8_t rank : registers_) {
+    sum += std::ldexp(1.0, -int(rank));
+    zeroes += rank == 0;
+  }
+
+  double alpha;
+  switch (registers_.size()) {
+  case 16: alpha = 0.673; break;
+  case 32: alpha = 0.697; break;
+  case 64: alpha = 0.709; break;
+  default: alpha = 0.7213 / (1.0 + 1.079 / count); break;
+  }
+
+  const double raw = alpha * count * count / sum;
+  if (raw <= 2.5 * count && zeroes != 0) {
+    return count * std::log(count / double(zeroes));
+  }
+  return raw;
+}
+
+
+
+void hyperloglog_t::clear()
+{
+  std::fill(registers_.begin(), registers_.end(), uint8_t(0));
+}
+
+
+
+void hyperloglog_t::merge(const hyperloglog_t &other)
+{
+  check_merge(precision_ == other.precision_, seed_, other.seed_,
+              "hyperloglog_t");
+  for (size_t index = 0; index < registers_.size(); ++index) {
+    registers_[index] = std::max(registers_[index], other.registers_[index]);
+  }
+}
+
+
+
+size_t hyperloglog_t::serialized_size() const
+{
+  return sizeof(sketch_header_t) + registers_.size();
+}
+
+
+
+size_t hyperloglog_t::serialize(buffer_stream_t &out) const
+{
+  const sketch_header_t header {
+    HYPERLOGLOG_MAGIC, SKETCH_VERSION, seed_, { precision_, 0 }
+  };
+  return write_sketch(out, header, registers_.data(), registers_.size());
+}
+
+
+
+bool hyperloglog_t::deserialize(const buffer_stream_t &in)
+{
+  sketch_header_t header;
+  if (!peek_header(in, HYPERLOGLOG_MAGIC, header) ||
+      header.params[0] < MIN_PRECISION || header.params[0] > MAX_PRECISION ||
+      in.remainder() - sizeof(header) < (size_t(1) << header.params[0])) {
+    return false;
+  }
+
+  std::vector<uint8_t> registers(size_t(1) << header.params[0]);
+  read_sketch(in, registers.data(), registers.size());
+  precision_ = unsigned(header.params[0]);
+  seed_ = header.seed;
+  registers_ = std::move(registers);
+  return true;
+}
+
+
+} // namespace snow
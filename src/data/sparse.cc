@@ -8,26 +8,20 @@
 
 
 #include "snow/data/sparse.hh"
+#include <algorithm>
+#include <cstring>
 #include <sstream>
 
 namespace snow {
 namespace sparse {
 
-#define CHECK_FLAG(FLAGS, FLAG) (((FLAGS)&(FLAG))==(FLAG))
-
 /// Static function declarations
 namespace {
 
-// Gets the escaped form of a given character code
-inline char escaped_char(char ch);
 // Used for basic error messages
 inline string error_with_position(position_t pos, const string &str);
-
-
-
-/// Constants
-
-const size_t SP_INIT_BUFFER_CAPACITY = 64;
+// Parses a mapped file's contents with parser.
+bool parse_mapped_file(const mapped_file_t &file, parser_t &parser);
 
 
 
@@ -40,17 +34,17 @@ inline string error_with_position(position_t pos, const string &str)
   return stream.str();
 }
 
-inline char escaped_char(char ch) {
-  switch (ch) {
-  case 'n': case 'N': return '\n';
-  case 'r': case 'R': return '\r';
-  case 'a': case 'A': return '\a';
-  case 'b': case 'B': return '\b';
-  case 'f': case 'F': return '\f';
-  case 't': case 'T': return '\t';
-  case '0':           return '\0';
-  default:            return ch;
+bool parse_mapped_file(const mapped_file_t &file, parser_t &parser)
+{
+  // The parser is closed from the start if it has no callback
+  if (!parser.is_open()) {
+    return false;
   }
+  parser.add_source(file.data(), file.size());
+  if (parser.is_open()) {
+    parser.close();
+  }
+  return !parser.have_error();
 }
 
 } // anonymous namespace
@@ -71,47 +65,139 @@ std::ostream &operator << (std::ostream &out, const position_t &pos)
 
 
 
+/// line_index_t
+
+line_index_t::line_index_t(const char *source, size_t length) :
+  source_(source), length_(length), built_(false)
+{
+  /* nop */
+}
+
+position_t line_index_t::position(size_t offset) const
+{
+  if (!built_) {
+    build();
+  }
+  if (offset > length_) {
+    offset = length_;
+  }
+
+  // The first line start past offset is one past the line containing it
+  const size_t line = size_t(std::upper_bound(line_starts_.begin(),
+                                              line_starts_.end(), offset) -
+                             line_starts_.begin());
+  const size_t line_start = line == 0 ? 0 : line_starts_[line - 1];
+  return position_t { line + 1, offset - line_start + 1, offset };
+}
+
+size_t line_index_t::line_count() const
+{
+  if (!built_) {
+    build();
+  }
+  return line_starts_.size() + 1;
+}
+
+void line_index_t::build() const
+{
+  const char *const end = source_ + length_;
+  const char *iter = source_;
+  while (iter < end &&
+         (iter = (const char *)std::memchr(iter, '\n', size_t(end - iter)))) {
+    iter += 1;
+    line_starts_.push_back(size_t(iter - source_));
+  }
+  built_ = true;
+}
+
+
+
+/// parse_state_t
+
+const size_t parse_state_t::position_stack_t::INLINE_DEPTH;
+const size_t parse_state_t::LINE_COUNT_BLOCK;
+
+parse_state_t::parse_state_t()
+{
+  reset();
+}
+
+void parse_state_t::reset()
+{
+  closed = false;
+  pos = { 1, 1, 0 };
+  start = { 1, 1, 0 };
+  space_count = 0;
+  mode = FIND_NAME;
+  escaped = false;
+  last_char = ' ';
+  buffer.clear();
+  error.clear();
+  view = nullptr;
+  view_length = 0;
+  offset = 0;
+  line_start = 0;
+  counted = nullptr;
+  openings.clear();
+}
+
+string parse_state_t::error_at_pos(const char *message) const
+{
+  return error_with_position(pos, message);
+}
+
+string parse_state_t::unclosed_error() const
+{
+  std::stringstream stream;
+  stream << pos
+    << " Unexpected end of document - expected '}' to match '{' at "
+    << openings.top();
+  return stream.str();
+}
+
+
+
 /// parser_t
 
-const parser_t::state_t parser_t::DEFAULT_STATE = {
-  false,                       // closed
-  { 1, 1 },                    // pos
-  { 1, 1 },                    // start
-  0,                           // space_count
-  parser_t::FIND_NAME,         // mode
-  false,                       // escaped
-  ' ',                         // last_char
-  parse_func_t(),              // func
-  string(),                    // buffer
-  string(),                    // error
-  parser_t::position_stack_t() // openings
-};
+template <int Options>
+void parser_t::parse_with(parse_state_t &state, handler_t &handler,
+                          const char *source, size_t length)
+{
+  parse_source<Options>(state, handler, source, length);
+}
+
+void parser_t::handler_t::operator () (source_kind_t kind, const char *str,
+                                       size_t length, position_t pos)
+{
+  if (parser->view_func_) {
+    parser->view_func_(kind, str, length, pos);
+  } else if (parser->func_) {
+    parser->token_.assign(str, string::size_type(length));
+    parser->func_(kind, parser->token_, pos);
+  }
+}
 
 parser_t::parser_t(int options, parse_func_t callback)
-  : options_({
-      // consume_ws
-      CHECK_FLAG(options, SP_CONSUME_WHITESPACE),
-      // trim_spaces
-      CHECK_FLAG(options, SP_TRIM_TRAILING_SPACES),
-      // nameless_roots
-      (CHECK_FLAG(options, SP_NAMELESS_ROOT_NODES) ||
-       // Nameless nodes necessitates support for nameless roots
-       CHECK_FLAG(options, SP_NAMELESS_NODES)),
-      // nameless_nodes
-      CHECK_FLAG(options, SP_NAMELESS_NODES)
-    }),
-    state_(DEFAULT_STATE)
-{
-  if (!callback) {
+  : options_(options & 0x1F), func_(std::move(callback))
+{
+  if (!func_) {
+    state_.closed = true;
+    state_.error = "Invalid parser function";
+  }
+}
+
+parser_t::parser_t(int options, view_func_t callback)
+  : options_(options & 0x1F), view_func_(std::move(callback))
+{
+  if (!view_func_) {
     state_.closed = true;
     state_.error = "Invalid parser function";
-  } else {
-    state_.buffer.reserve(SP_INIT_BUFFER_CAPACITY);
   }
 }
 
 parser_t::parser_t(const parser_t &other)
-  : options_(other.options_), state_(other.state_)
+  : options_(other.options_), state_(other.state_), func_(other.func_),
+    view_func_(other.view_func_)
 {}
 
 parser_t::~parser_t()
@@ -120,186 +206,225 @@ parser_t::~parser_t()
 
 void parser_t::add_source(const string &source)
 {
-  const char *source_cst = source.c_str();
-  const char *source_cst_end = source_cst + source.size();
-
-  for (; source_cst < source_cst_end; ++source_cst) {
-    const char current = *source_cst;
-
-    if (state_.mode == READ_COMMENT) {
-      // If in a comment, read until the end of the line. In all cases, if an
-      // end of line occurs, the next mode will necessarily be FIND_NAME (this
-      // is because it's impossible to end a line with a comment without
-      // also ending a value or name if one was being read).
-      if (current == '\n')
-        state_.mode = FIND_NAME;
-    } else if (state_.escaped) {
-      // Handle escaped character
-      state_.buffer_char(escaped_char(current), options_);
-      state_.escaped = false;
-    } else {
-      // Generic parsing
-      switch (current) {
-      case ' ':  // Whitespace
-      case '\t': // Whitespace
-        if ((options_.consume_ws && state_.last_char == current) ||
-            state_.mode == FIND_NAME || state_.mode == FIND_VALUE) {
-          // NOP
-        } else if (state_.mode == READ_NAME) {
-          state_.send_buffer_and_reset(SP_NAME, options_);
-          state_.mode = FIND_VALUE;
-        } else {
-          state_.buffer_char(current, options_);
-        }
-        break; // END ' ' & '\t'
-
-      case '{': // Start of node
-        switch (state_.mode) {
-        case READ_NAME:
-          state_.send_buffer_and_reset(SP_NAME, options_);
-        case FIND_VALUE:
-          state_.openings.push(state_.pos);
-          state_.send_string(SP_OPEN_NODE, "{");
-          break;
-
-        case READ_VALUE:
-          state_.send_buffer_and_reset(SP_VALUE, options_);
-        case FIND_NAME:
-          if ((options_.nameless_roots && state_.openings.size() == 0) ||
-              options_.nameless_nodes) {
-            state_.openings.push(state_.pos);
-            state_.send_string(SP_NAME, "");
-          } else {
-            default:
-            state_.close_with_error(error_with_position(state_.pos,
-                                    "Invalid character '{' - expected name."));
-            return;
-          }
-        }
-        state_.mode = FIND_NAME;
-        break; // END '{'
-
-      case '}':  // Ened of node
-      case '\n': // End-line terminator
-      case ';':  // Inline terminator
-      case '#':  // Comment
-        switch (state_.mode) {
-        case READ_NAME:  state_.send_buffer_and_reset(SP_NAME, options_);
-        case FIND_VALUE: state_.send_string(SP_VALUE, ""); break;
-        case READ_VALUE: state_.send_buffer_and_reset(SP_VALUE, options_); break;
-        default: break;
-        }
-
-        if (current == '}') {
-          // End of node
-          if (state_.openings.size() == 0) {
-            state_.close_with_error(error_with_position(state_.pos,
-                                    "Unexpected '}' - no matching '{'."));
-            return;
-          }
-          state_.openings.pop();
-          state_.mode = FIND_NAME;
-          state_.send_string(SP_CLOSE_NODE, "}");
-        } // if (current == '}')
-
-        state_.mode = FIND_NAME << (4 * (current == '#'));
-        break;
-
-      case '\\': // Escape
-        state_.escaped = true;
-        break;
-
-      default:
-        if (state_.mode < READ_NAME) { // if mode is find_name or find_value
-          state_.mode <<= 2;           // shift it to read_name or read_value
-          state_.start = state_.pos;   // and store the token's starting pos
-        }
-
-        state_.buffer_char(current, options_);
-        break;
-      }
-    }
+  add_source(source.data(), size_t(source.size()));
+}
 
-    if (current == '\n') {
-      state_.pos.line += 1;
-      state_.pos.column = 1;
-    } else {
-      state_.pos.column += 1;
-    }
+void parser_t::add_source(const char *source, size_t length)
+{
+  static const source_func_t source_funcs[32] = {
+    parse_with<0x00>, parse_with<0x01>, parse_with<0x02>, parse_with<0x03>,
+    parse_with<0x04>, parse_with<0x05>, parse_with<0x06>, parse_with<0x07>,
+    parse_with<0x08>, parse_with<0x09>, parse_with<0x0A>, parse_with<0x0B>,
+    parse_with<0x0C>, parse_with<0x0D>, parse_with<0x0E>, parse_with<0x0F>,
+    parse_with<0x10>, parse_with<0x11>, parse_with<0x12>, parse_with<0x13>,
+    parse_with<0x14>, parse_with<0x15>, parse_with<0x16>, parse_with<0x17>,
+    parse_with<0x18>, parse_with<0x19>, parse_with<0x1A>, parse_with<0x1B>,
+    parse_with<0x1C>, parse_with<0x1D>, parse_with<0x1E>, parse_with<0x1F>,
+  };
+  static_assert(((SP_DEFAULT_OPTIONS | SP_LAZY_POSITIONS) & ~0x1F) == 0,
+                "All option flags must fit in the low five bits");
+
+  handler_t handler { this };
+  source_funcs[options_](state_, handler, source, length);
+}
 
-    state_.last_char = current;
+void parser_t::close()
+{
+  handler_t handler { this };
+  parse_close(state_, handler);
+}
+
+void parser_t::reset()
+{
+  state_.reset();
+  if (!func_ && !view_func_) {
+    state_.closed = true;
+    state_.error = "Invalid parser function";
   }
 }
 
-void parser_t::close()
+
+
+
+/// parse_file
+
+bool parse_file(const char *path, int options, view_func_t handler)
 {
-  if (state_.closed)
-    s_throw(std::runtime_error, "Attempt to close already-closed parser.");
+  mapped_file_t file;
+  if (!file.open(path, mapped_file_t::ACCESS_SEQUENTIAL)) {
+    if (handler) {
+      handler(SP_ERROR, file.error().data(), size_t(file.error().size()), position_t { 0, 0, 0 });
+    }
+    return false;
+  }
+
+  parser_t parser(options, std::move(handler));
+  return parse_mapped_file(file, parser);
+}
 
-  switch (state_.mode) {
-  case READ_NAME:  state_.send_buffer_and_reset(SP_NAME, options_);
-  case FIND_VALUE: state_.send_string(SP_VALUE, ""); break;
-  case READ_VALUE: state_.send_buffer_and_reset(SP_VALUE, options_); break;
-  default: break;
+bool parse_file(const char *path, int options, parse_func_t handler)
+{
+  mapped_file_t file;
+  if (!file.open(path, mapped_file_t::ACCESS_SEQUENTIAL)) {
+    if (handler) {
+      handler(SP_ERROR, file.error(), position_t { 0, 0, 0 });
+    }
+    return false;
   }
 
-  if (state_.openings.size() > 0) {
-    std::stringstream stream;
-    stream << state_.pos
-      << " Unexpected end of document - expected '}' to match '{' at "
-      << state_.openings.top();
-    state_.close_with_error(stream.str());
-    return;
+  parser_t parser(options, std::move(handler));
+  return parse_mapped_file(file, parser);
+}
+
+
+
+/// reader_t
+
+template <int Options>
+size_t reader_t::parse_with(parse_state_t &state, handler_t &handler,
+                            const char *source, size_t length)
+{
+  return parse_source<Options, true>(state, handler, source, length);
+}
+
+void reader_t::handler_t::operator () (source_kind_t kind, const char *str,
+                                       size_t length, position_t pos)
+{
+  const size_t index = reader->count_++;
+  token_t &token = reader->pending_[index];
+  token.kind = kind;
+  token.pos = pos;
+  token.length = length;
+
+  // Names and values not pointing into the source are in the parser's buffer
+  // and errors are in a temporary, so copy those. Anything else is a literal.
+  const bool in_source = str >= reader->source_ && str < reader->source_end_;
+  if (length > 0 && !in_source &&
+      (kind == SP_NAME || kind == SP_VALUE || kind == SP_ERROR)) {
+    string &text = reader->text_[index];
+    text.assign(str, string::size_type(length));
+    token.str = text.data();
+  } else {
+    token.str = str;
   }
+}
 
-  state_.buffer.resize(0);
-  state_.closed = true;
+reader_t::reader_t(int options)
+  : source_(nullptr), source_end_(nullptr), closing_(false), depth_(0),
+    skipping_(false), skip_depth_(0), read_(0), count_(0)
+{
+  static const source_func_t source_funcs[16] = {
+    parse_with<0x0>, parse_with<0x1>, parse_with<0x2>, parse_with<0x3>,
+    parse_with<0x4>, parse_with<0x5>, parse_with<0x6>, parse_with<0x7>,
+    parse_with<0x8>, parse_with<0x9>, parse_with<0xA>, parse_with<0xB>,
+    parse_with<0xC>, parse_with<0xD>, parse_with<0xE>, parse_with<0xF>,
+  };
+
+  parse_ = source_funcs[options & 0xF];
+}
 
-  state_.send_string(SP_DONE, "");
+reader_t::reader_t(const char *source, size_t length, int options)
+  : reader_t(options)
+{
+  add_source(source, length);
+  close();
 }
 
+void reader_t::add_source(const char *source, size_t length)
+{
+  if (closing_ || state_.closed)
+    s_throw(std::logic_error, "Attempt to add source to closed reader.");
+  else if (source_ != source_end_)
+    s_throw(std::logic_error, "Attempt to add source before previous source was read.");
 
-// Note: source may be a reference to state_.buffer.
-inline void parser_t::state_t::send_buffer_and_reset(source_kind_t kind, const options_t &options)
+  source_ = source;
+  source_end_ = source + length;
+}
+
+void reader_t::add_source(const string &source)
 {
-  // Unlike send_string, send the starting position for a token instead of the
-  // current reader position
-  if (func) func(kind, trimmed_buffer(options), start);
-  buffer.clear();
+  add_source(source.data(), size_t(source.size()));
 }
 
-void parser_t::state_t::send_string(source_kind_t kind, const string &source)
+void reader_t::close()
 {
-  if (func) func(kind, source, pos);
+  if (closing_ || state_.closed)
+    s_throw(std::logic_error, "Attempt to close already-closed reader.");
+  closing_ = true;
 }
 
-void parser_t::state_t::buffer_char(char c, const options_t &options)
+void reader_t::reset()
 {
-  if (c != ' ' || escaped)
-    space_count = 0;
-  else if ((c == ' ' || c == '\t') && options.trim_spaces)
-    space_count += 1;
+  state_.reset();
+  source_ = nullptr;
+  source_end_ = nullptr;
+  closing_ = false;
+  depth_ = 0;
+  skipping_ = false;
+  skip_depth_ = 0;
+  read_ = 0;
+  count_ = 0;
+}
 
-  buffer.push_back(c);
+void reader_t::fill()
+{
+  handler_t handler { this };
+  read_ = 0;
+  count_ = 0;
+
+  if (state_.closed) {
+    return;
+  } else if (source_ != source_end_) {
+    source_ += parse_(state_, handler, source_, size_t(source_end_ - source_));
+    if (state_.closed) {
+      // Stopped by an error, so there's nothing more to read
+      source_ = source_end_;
+    }
+  }
+
+  if (count_ == 0 && closing_ && source_ == source_end_) {
+    parse_close(state_, handler);
+  }
 }
 
-void parser_t::state_t::close_with_error(const string &error)
+bool reader_t::next(token_t &token)
 {
-  if (closed)
-    s_throw(std::runtime_error, "Attempt to close with error when already closed.");
-  send_string(SP_ERROR, error);
-  this->error = error;
-  closed = true;
+  for (;;) {
+    if (read_ == count_) {
+      fill();
+      if (count_ == 0)
+        return false;
+    }
+
+    const token_t &pending = pending_[read_++];
+    switch (pending.kind) {
+    case SP_OPEN_NODE:  depth_ += 1; break;
+    case SP_CLOSE_NODE: depth_ -= 1; break;
+    case SP_ERROR:
+    case SP_DONE:       skipping_ = false; break;
+    default: break;
+    }
+
+    if (skipping_) {
+      if (pending.kind == SP_CLOSE_NODE && depth_ == skip_depth_)
+        skipping_ = false;
+      continue;
+    }
+
+    token = pending;
+    return true;
+  }
 }
 
-// Returns the buffer byref after resizing it
-const string &parser_t::state_t::trimmed_buffer(const options_t &options)
+void reader_t::skip_node()
 {
-  if (options.trim_spaces && space_count > 0) {
-    buffer.resize(buffer.size() - space_count);
-    space_count = 0;
+  if (depth_ == 0)
+    s_throw(std::logic_error, "Attempt to skip node when no node is open.");
+  // Skipping an enclosing node also skips any node already being skipped
+  if (!skipping_ || depth_ - 1 < skip_depth_) {
+    skip_depth_ = depth_ - 1;
   }
-  return buffer;
+  skipping_ = true;
 }
 
 
@@ -0,0 +1,228 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#include "snow/data/sparse_binding.hh"
+#include "snow/data/hash.hh"
+#include "snow/data/mapped_file.hh"
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+
+namespace snow {
+namespace sparse {
+
+/// Static function declarations
+namespace {
+
+// Hashes an entry name. hash64 is mixed so that its low bits, which pick the
+// slot, depend on every byte of the name.
+uint64_t schema_hash(const char *name, size_t length);
+
+
+
+/// Constants
+
+const uint32_t SCHEMA_NO_ENTRY = UINT32_MAX;
+// Slots in a schema's table once it has any entries.
+const size_t SCHEMA_MIN_SLOTS = 8;
+
+
+
+/// Static function definitions
+
+uint64_t schema_hash(const char *name, size_t length)
+{
+  return hash_mix64(hash64(name, length));
+}
+
+} // anonymous namespace
+
+
+
+/// schema_base_t
+
+const size_t schema_base_t::MEMBER_SIZE;
+
+schema_base_t::schema_base_t() :
+  mask_(0)
+{
+  /* nop */
+}
+
+void schema_base_t::add(entry_t entry)
+{
+  entry.hash = schema_hash(entry.name.data(), size_t(entry.name.size()));
+  if (find_hashed(entry.name.data(), size_t(entry.name.size()), entry.hash)) {
+    s_throw(std::invalid_argument, "Schema already has an entry named '%s'.",
+            entry.name.c_str());
+  }
+
+  entries_.push_back(std::move(entry));
+  if (entries_.size() * 2 > slots_.size()) {
+    build_table(slots_.empty() ? SCHEMA_MIN_SLOTS : slots_.size() * 2);
+  } else {
+    insert_slot(uint32_t(entries_.size() - 1));
+  }
+}
+
+const schema_base_t::entry_t *schema_base_t::find(const char *name,
+                                                  size_t length) const
+{
+  return find_hashed(name, length, schema_hash(name, length));
+}
+
+const schema_base_t::entry_t *schema_base_t::find_hashed(const char *name,
+                                                         size_t length,
+                                                         uint64_t hash) const
+{
+  if (slots_.empty()) {
+    return nullptr;
+  }
+
+  // The table is never more than half full, so probing ends at a free slot
+  for (size_t slot = size_t(hash) & mask_;; slot = (slot + 1) & mask_) {
+    const uint32_t index = slots_[slot];
+    if (index == SCHEMA_NO_ENTRY) {
+      return nullptr;
+    }
+
+    const entry_t &entry = entries_[index];
+    if (entry.hash == hash && size_t(entry.name.size()) == length &&
+        std::memcmp(entry.name.data(), name, length) == 0) {
+      return &entry;
+    }
+  }
+}
+
+void schema_base_t::insert_slot(uint32_t index)
+{
+  size_t slot = size_t(entries_[index].hash) & mask_;
+  while (slots_[slot] != SCHEMA_NO_ENTRY) {
+    slot = (slot + 1) & mask_;
+  }
+  slots_[slot] = index;
+}
+
+void schema_base_t::build_table(size_t size)
+{
+  slots_.assign(size, SCHEMA_NO_ENTRY);
+  mask_ = size - 1;
+  for (uint32_t index = 0; index < entries_.size(); ++index) {
+    insert_slot(index);
+  }
+}
+
+
+
+/// binder_t
+
+template <int Options>
+void binder_t::parse_with(binder_t &binder, const char *source, size_t length)
+{
+  parse_state_t state;
+  parse_source<Options>(state, binder, source, length);
+  if (!state.closed) {
+    parse_close(state, binder);
+  }
+}
+
+bool binder_t::parse(const char *source, size_t length, int options)
+{
+  static const parse_func_t parse_funcs[16] = {
+    parse_with<0x0>, parse_with<0x1>, parse_with<0x2>, parse_with<0x3>,
+    parse_with<0x4>, parse_with<0x5>, parse_with<0x6>, parse_with<0x7>,
+    parse_with<0x8>, parse_with<0x9>, parse_with<0xA>, parse_with<0xB>,
+    parse_with<0xC>, parse_with<0xD>, parse_with<0xE>, parse_with<0xF>,
+  };
+
+  frames_.assign(1, root_);
+  entry_ = nullptr;
+  error_.clear();
+
+  parse_funcs[options & 0xF](*this, source, length);
+  return !have_error();
+}
+
+bool binder_t::parse(const string &source, int options)
+{
+  return parse(source.data(), size_t(source.size()), options);
+}
+
+bool binder_t::parse_file(const char *path, int options)
+{
+  mapped_file_t file;
+  if (!file.open(path, mapped_file_t::ACCESS_SEQUENTIAL)) {
+    error_ = file.error();
+    return false;
+  }
+  return parse(file.data(), file.size(), options);
+}
+
+void binder_t::operator () (source_kind_t kind, const char *str, size_t length,
+                            position_t pos)
+{
+  using entry_t = schema_base_t::entry_t;
+
+  switch (kind) {
+  case SP_NAME: {
+    const schema_base_t *const schema = frames_.back().schema;
+    entry_ = schema ? schema->find(str, length) : nullptr;
+    name_pos_ = pos;
+  } break;
+
+  case SP_VALUE:
+    if (!entry_) {
+      break;
+    } else if (entry_->kind != schema_base_t::FIELD) {
+      entry_error("Expected a node for");
+    } else if (!entry_->assign(entry_->member, frames_.back().object, str, length)) {
+      entry_error("Invalid value for");
+    }
+    break;
+
+  case SP_OPEN_NODE: {
+    frame_t frame { nullptr, nullptr };
+    if (entry_ && entry_->kind == schema_base_t::FIELD) {
+      entry_error("Expected a value for");
+    } else if (entry_) {
+      const entry_t &entry = *entry_;
+      frame.object = entry.enter(entry.member, frames_.back().object);
+      frame.schema = entry.schema;
+    }
+    frames_.push_back(frame);
+    entry_ = nullptr;
+  } break;
+
+  case SP_CLOSE_NODE:
+    frames_.pop_back();
+    break;
+
+  case SP_ERROR:
+    if (error_.empty()) {
+      error_.assign(str, string::size_type(length));
+    }
+    break;
+
+  default: break;
+  }
+}
+
+void binder_t::entry_error(const char *message)
+{
+  if (!error_.empty()) {
+    return;
+  }
+  std::stringstream stream;
+  stream << name_pos_ << ' ' << message << " '" << entry_->name.c_str() << "'.";
+  error_ = stream.str();
+}
+
+
+} // namespace sparse
+} // namespace snow
@@ -0,0 +1,1470 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#include "snow/data/sparse_document.hh"
+#include "snow/data/hash.hh"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace snow {
+namespace sparse {
+
+/// Static function declarations
+namespace {
+
+// Returns an upper bound on the number of nodes a source can produce, so
+// node storage can be allocated once.
+size_t estimate_node_count(const char *source, size_t length);
+// Splits a source into parts of at least part_size bytes, each ending on a
+// newline outside of any node. See document_t::part_t.
+std::vector<document_t::part_t> split_parts(const char *source, size_t length,
+                                            size_t part_size);
+// Hashes a node name for the name index. The hash is mixed so that its low
+// bits, which pick the slot, depend on every byte of the name.
+uint32_t name_hash(const char *name, size_t length);
+// Returns the size of the name table for a node with the given number of
+// children.
+size_t name_table_size(size_t children);
+// Path lookup shared by document_t and compiled_document_t, given their name
+// tables and slots.
+template <typename Document, typename Offset>
+uint32_t find_child_node(const Document &doc, const Offset *tables,
+                         const document_t::name_slot_t *names, uint32_t parent,
+                         const char *name, size_t length);
+template <typename Document, typename Offset>
+uint32_t find_path(const Document &doc, const Offset *tables,
+                   const document_t::name_slot_t *names, const char *path,
+                   size_t length, uint32_t from);
+// Returns the children of a node, in order.
+std::vector<document_t::index_t> child_nodes(const document_t &doc,
+                                             document_t::index_t parent);
+// Compares the names of two nodes, possibly of different documents, as
+// memcmp would.
+int compare_names(const document_t &left_doc, document_t::index_t left,
+                  const document_t &right_doc, document_t::index_t right);
+// Appends the differences between old_nodes of old_doc and new_nodes of
+// new_doc, siblings whose parent is at path, to changes. Node i of new_doc
+// will be node new_base + i - 1 of the updated document.
+void diff_nodes(const document_t &old_doc, std::vector<document_t::index_t> old_nodes,
+                const document_t &new_doc, std::vector<document_t::index_t> new_nodes,
+                const string &path, document_t::index_t new_base,
+                std::vector<document_t::change_t> &changes);
+
+
+
+/// Constants
+
+const size_t DOC_INIT_STACK_CAPACITY = 16;
+
+// parse_parallel doesn't split sources into parts smaller than this.
+const size_t DOC_MIN_PART_SIZE = 256 * 1024;
+const size_t DOC_PARTS_PER_THREAD = 4;
+
+// Magic number at the start of a compiled image ("SPDC" when read as bytes)
+const uint32_t DOC_IMAGE_MAGIC = 0x43445053U;
+
+
+
+/// Image format
+
+// Header of a compiled image. Followed by node_count compiled nodes, then the
+// name index as node_count + 1 uint32_t table offsets and name_slots slots,
+// and then text_size bytes of NUL-terminated names and values.
+struct image_header_t
+{
+  uint32_t magic;
+  uint32_t version;
+  uint32_t node_count;
+  uint32_t node_size;
+  uint64_t text_size;
+  uint64_t name_slots;
+};
+
+static_assert(sizeof(image_header_t) % alignof(compiled_document_t::node_t) == 0,
+              "Compiled nodes must be aligned after the image header");
+static_assert(alignof(document_t::name_slot_t) == alignof(uint32_t) &&
+              sizeof(document_t::name_slot_t) == 2 * sizeof(uint32_t),
+              "Name index slots must be written as they're stored");
+
+// The image of an empty document, used when a compiled_document_t has no
+// image loaded.
+const compiled_document_t::node_t DOC_EMPTY_ROOT = {
+  compiled_document_t::NO_NODE, compiled_document_t::NO_NODE,
+  compiled_document_t::NO_NODE, 1, 0, 0, 0, 0, 1, 1
+};
+const uint32_t DOC_EMPTY_NAME_TABLES[2] = { 0, 0 };
+const char DOC_EMPTY_TEXT[1] = { '\0' };
+
+
+
+/// Static function definitions
+
+size_t estimate_node_count(const char *source, size_t length)
+{
+  // Every node but the last is ended by a newline, semicolon, or closing
+  // brace, and every closing brace is matched by an opening brace.
+  size_t count = 2;
+  for (const char *const end = source + length; source < end; ++source) {
+    switch (*source) {
+    case '\n': case ';': count += 1; break;
+    case '{': count += 2; break;
+    default: break;
+    }
+  }
+  return count;
+}
+
+std::vector<document_t::part_t> split_parts(const char *source, size_t length,
+                                            size_t part_size)
+{
+  // Tracks just enough of the parser's state to know when it's outside of any
+  // node and not reading anything: after an unescaped newline at depth zero.
+  // Any '{' the parser accepts opens a node, and a '}' at depth zero is an
+  // error that ends parsing, so the depth here matches the parser's up to the
+  // first error.
+  std::vector<document_t::part_t> parts;
+  const char *const end = source + length;
+  const char *part_start = source;
+  position_t start { 1, 1, 0 };
+  size_t line = 1;
+  size_t depth = 0;
+  bool comment = false;
+  bool escaped = false;
+
+  for (const char *iter = source; iter < end; ++iter) {
+    const char current = *iter;
+    if (comment) {
+      comment = current != '\n';
+    } else if (escaped) {
+      escaped = false;
+      if (current == '\n')
+        line += 1;
+      continue;
+    } else {
+      switch (current) {
+      case '\\': escaped = true; continue;
+      case '#':  comment = true; continue;
+      case '{':  depth += 1; continue;
+      case '}':  depth -= (depth > 0); continue;
+      default:   break;
+      }
+    }
+
+    if (current != '\n')
+      continue;
+
+    line += 1;
+    const char *const next = iter + 1;
+    if (depth == 0 && size_t(next - part_start) >= part_size && next < end) {
+      parts.push_back(document_t::part_t { part_start, size_t(next - part_start), start });
+      part_start = next;
+      start = position_t { line, 1, size_t(next - source) };
+    }
+  }
+
+  parts.push_back(document_t::part_t { part_start, size_t(end - part_start), start });
+  return parts;
+}
+
+uint32_t name_hash(const char *name, size_t length)
+{
+  return uint32_t(hash_mix64(hash64_block(name, length)));
+}
+
+size_t name_table_size(size_t children)
+{
+  if (children == 0) {
+    return 0;
+  }
+  size_t size = 2;
+  while (size < children * 2) {
+    size <<= 1;
+  }
+  return size;
+}
+
+template <typename Document, typename Offset>
+uint32_t find_child_node(const Document &doc, const Offset *tables,
+                         const document_t::name_slot_t *names, uint32_t parent,
+                         const char *name, size_t length)
+{
+  const document_t::name_slot_t *const slots = names + tables[parent];
+  const size_t size = size_t(tables[parent + 1] - tables[parent]);
+  if (size == 0) {
+    return Document::NO_NODE;
+  }
+
+  // Tables are never more than half full, so probing ends at a free slot
+  const uint32_t hash = name_hash(name, length);
+  const size_t mask = size - 1;
+  for (size_t slot = size_t(hash) & mask;; slot = (slot + 1) & mask) {
+    const document_t::name_slot_t &entry = slots[slot];
+    if (entry.node == Document::NO_NODE ||
+        (entry.hash == hash && doc.name_length(entry.node) == length &&
+         std::memcmp(doc.name(entry.node), name, length) == 0)) {
+      return entry.node;
+    }
+  }
+}
+
+template <typename Document, typename Offset>
+uint32_t find_path(const Document &doc, const Offset *tables,
+                   const document_t::name_slot_t *names, const char *path,
+                   size_t length, uint32_t from)
+{
+  const char *const path_end = path + length;
+  uint32_t index = from;
+
+  while (index != Document::NO_NODE) {
+    const char *const sep =
+      (const char *)std::memchr(path, '/', size_t(path_end - path));
+    const char *const name_end = sep ? sep : path_end;
+    index = find_child_node(doc, tables, names, index, path,
+                            size_t(name_end - path));
+    if (!sep) {
+      break;
+    }
+    path = sep + 1;
+  }
+
+  return index;
+}
+
+std::vector<document_t::index_t> child_nodes(const document_t &doc,
+                                             document_t::index_t parent)
+{
+  std::vector<document_t::index_t> children;
+  document_t::index_t child = doc.first_child(parent);
+  for (; child != document_t::NO_NODE; child = doc.next_sibling(child)) {
+    children.push_back(child);
+  }
+  return children;
+}
+
+int compare_names(const document_t &left_doc, document_t::index_t left,
+                  const document_t &right_doc, document_t::index_t right)
+{
+  const size_t left_length = left_doc.name_length(left);
+  const size_t right_length = right_doc.name_length(right);
+  const int order = std::memcmp(left_doc.name(left), right_doc.name(right),
+                                std::min(left_length, right_length));
+  if (order != 0) {
+    return order;
+  }
+  return (left_length > right_length) - (left_length < right_length);
+}
+
+void diff_nodes(const document_t &old_doc, std::vector<document_t::index_t> old_nodes,
+                const document_t &new_doc, std::vector<document_t::index_t> new_nodes,
+                const string &path, document_t::index_t new_base,
+                std::vector<document_t::change_t> &changes)
+{
+  using index_t = document_t::index_t;
+  using change_t = document_t::change_t;
+
+  // Sorting stably by name lines up the nth node of each name in both lists
+  std::stable_sort(old_nodes.begin(), old_nodes.end(), [&] (index_t left, index_t right) {
+    return compare_names(old_doc, left, old_doc, right) < 0;
+  });
+  std::stable_sort(new_nodes.begin(), new_nodes.end(), [&] (index_t left, index_t right) {
+    return compare_names(new_doc, left, new_doc, right) < 0;
+  });
+
+  const auto node_path = [&path] (const document_t &doc, index_t node) {
+    string node_path(path);
+    node_path.append(doc.name(node), string::size_type(doc.name_length(node)));
+    return node_path;
+  };
+
+  size_t old_index = 0;
+  size_t new_index = 0;
+  while (old_index < old_nodes.size() || new_index < new_nodes.size()) {
+    int order;
+    if (old_index == old_nodes.size()) {
+      order = 1;
+    } else if (new_index == new_nodes.size()) {
+      order = -1;
+    } else {
+      order = compare_names(old_doc, old_nodes[old_index], new_doc, new_nodes[new_index]);
+    }
+
+    if (order < 0) {
+      const index_t old_node = old_nodes[old_index++];
+      changes.push_back(change_t { change_t::REMOVED, node_path(old_doc, old_node),
+                                   document_t::NO_NODE });
+      continue;
+    }
+
+    const index_t new_node = new_nodes[new_index++];
+    if (order > 0) {
+      changes.push_back(change_t { change_t::ADDED, node_path(new_doc, new_node),
+                                   new_base + new_node - 1 });
+      continue;
+    }
+
+    const index_t old_node = old_nodes[old_index++];
+    if (old_doc.is_branch(old_node) != new_doc.is_branch(new_node) ||
+        (!old_doc.is_branch(old_node) &&
+         (old_doc.value_length(old_node) != new_doc.value_length(new_node) ||
+          std::memcmp(old_doc.value(old_node), new_doc.value(new_node),
+                      old_doc.value_length(old_node)) != 0))) {
+      changes.push_back(change_t { change_t::MODIFIED, node_path(new_doc, new_node),
+                                   new_base + new_node - 1 });
+    } else if (old_doc.is_branch(old_node)) {
+      string child_path = node_path(new_doc, new_node);
+      child_path.append('/');
+      diff_nodes(old_doc, child_nodes(old_doc, old_node),
+                 new_doc, child_nodes(new_doc, new_node),
+                 child_path, new_base, changes);
+    }
+  }
+}
+
+} // anonymous namespace
+
+
+
+/// document_t
+
+const document_t::index_t document_t::NO_NODE;
+const document_t::index_t document_t::ROOT;
+
+template <int Options>
+void document_t::build_with(document_t &doc, const char *source, size_t length,
+                            position_t start, bool last, part_end_t *end)
+{
+  parse_state_t state;
+  builder_t builder { &doc };
+  state.pos = start;
+  state.offset = start.offset;
+  state.line_start = start.offset;
+  parse_source<Options>(state, builder, source, length);
+  if (last && !state.closed) {
+    parse_close(state, builder);
+  }
+  if (end) {
+    end->pos = state.pos;
+    end->between_nodes = state.mode == parse_state_t::FIND_NAME &&
+                         !state.escaped && state.openings.empty();
+  }
+}
+
+void document_t::builder_t::operator () (source_kind_t kind, const char *str,
+                                         size_t length, position_t pos)
+{
+  std::vector<node_t> &nodes = doc->nodes_;
+
+  switch (kind) {
+  case SP_NAME: {
+    const index_t index = index_t(nodes.size());
+    const index_t parent = doc->open_.back();
+    index_t &last = doc->last_child_.back();
+
+    node_t node;
+    node.parent = parent;
+    node.first_child = NO_NODE;
+    node.next_sibling = NO_NODE;
+    node.branch = false;
+    node.name_offset = doc->add_text(str, length);
+    node.name_length = length;
+    node.value_offset = 0;
+    node.value_length = 0;
+    node.pos = pos;
+    nodes.push_back(node);
+
+    if (last == NO_NODE) {
+      nodes[parent].first_child = index;
+    } else {
+      nodes[last].next_sibling = index;
+    }
+    last = index;
+  } break;
+
+  case SP_VALUE:
+    // Values always directly follow their names
+    nodes.back().value_offset = doc->add_text(str, length);
+    nodes.back().value_length = length;
+    break;
+
+  case SP_OPEN_NODE:
+    nodes.back().branch = true;
+    doc->open_.push_back(index_t(nodes.size() - 1));
+    doc->last_child_.push_back(NO_NODE);
+    break;
+
+  case SP_CLOSE_NODE:
+    doc->open_.pop_back();
+    doc->last_child_.pop_back();
+    break;
+
+  case SP_ERROR:
+    doc->error_.assign(str, string::size_type(length));
+    break;
+
+  default: break;
+  }
+}
+
+template <int Options>
+void document_t::select_with(selector_t &selector, const char *source, size_t length)
+{
+  parse_state_t state;
+  const char *const end = source + length;
+  do {
+    source += parse_source<Options, true>(state, selector, source, size_t(end - source));
+    if (selector.skipping) {
+      // The parser stopped just inside a branch off the path, so carry on
+      // from the brace that closes it
+      const char *const close = find_node_end(source, end);
+      state.skip_source(source, close);
+      source = close;
+      selector.skipping = false;
+    }
+  } while (source < end && !state.closed);
+
+  if (!state.closed) {
+    parse_close(state, selector);
+  }
+}
+
+void document_t::selector_t::operator () (source_kind_t kind, const char *str,
+                                          size_t length, position_t pos)
+{
+  // Nodes deeper than the last name in the path are inside a selected node
+  const size_t last = path->size() - 1;
+
+  switch (kind) {
+  case SP_NAME:
+    if (depth <= last) {
+      const segment_t &name = (*path)[depth];
+      matched = (name.second == 1 && name.first[0] == '*') ||
+                (name.second == length && std::memcmp(name.first, str, length) == 0);
+      if (depth < last || !matched) {
+        break;
+      }
+    }
+    builder(kind, str, length, pos);
+    break;
+
+  case SP_VALUE:
+    if (depth > last || (depth == last && matched)) {
+      builder(kind, str, length, pos);
+    }
+    break;
+
+  case SP_OPEN_NODE:
+    if (depth > last || (depth == last && matched)) {
+      builder(kind, str, length, pos);
+    } else if (!matched) {
+      skipping = true;
+    }
+    depth += 1;
+    break;
+
+  case SP_CLOSE_NODE:
+    depth -= 1;
+    if (depth > last || (depth == last && matched)) {
+      builder(kind, str, length, pos);
+    }
+    break;
+
+  default:
+    builder(kind, str, length, pos);
+    break;
+  }
+}
+
+document_t::document_t()
+{
+  open_.reserve(DOC_INIT_STACK_CAPACITY);
+  last_child_.reserve(DOC_INIT_STACK_CAPACITY);
+  clear();
+}
+
+bool document_t::parse(const char *source, size_t length, int options)
+{
+  clear();
+  error_.clear();
+
+  if (length >= size_t(NO_NODE)) {
+    error_ = "Source is too large for a document.";
+    return false;
+  }
+
+  if (!parse_part(source, length, options, position_t { 1, 1, 0 }, true)) {
+    return false;
+  }
+  index_names();
+  return true;
+}
+
+bool document_t::parse_parallel(const char *source, size_t length, int options,
+                                unsigned thread_count)
+{
+  clear();
+  error_.clear();
+
+  if (length >= size_t(NO_NODE)) {
+    error_ = "Source is too large for a document.";
+    return false;
+  }
+
+  if (thread_count == 0) {
+    thread_count = std::max(std::thread::hardware_concurrency(), 1U);
+  }
+
+  // Aim for a few parts per thread so that uneven parts balance out
+  const size_t part_size = std::max(length / (size_t(thread_count) * DOC_PARTS_PER_THREAD),
+                                    DOC_MIN_PART_SIZE);
+  const std::vector<part_t> parts = split_parts(source, length, part_size);
+  if (thread_count == 1 || parts.size() == 1) {
+    if (!parse_part(source, length, options, position_t { 1, 1, 0 }, true)) {
+      return false;
+    }
+    index_names();
+    return true;
+  }
+
+  std::vector<document_t> docs(parts.size());
+  std::atomic<size_t> next_part { 0 };
+
+#if USE_EXCEPTIONS
+  // The first exception thrown while parsing a part, rethrown once every
+  // thread has been joined
+  std::exception_ptr failure;
+  std::mutex failure_lock;
+#endif
+
+  const auto parse_parts = [&] {
+#if USE_EXCEPTIONS
+    try {
+#endif
+      size_t index;
+      while ((index = next_part.fetch_add(1, std::memory_order_relaxed)) < parts.size()) {
+        const part_t &part = parts[index];
+        if (docs[index].parse_part(part.source, part.length, options, part.start,
+                                   index + 1 == parts.size())) {
+          docs[index].index_names();
+        }
+      }
+#if USE_EXCEPTIONS
+    } catch (...) {
+      // Stop handing out parts, since the parse has failed anyway
+      next_part.store(parts.size(), std::memory_order_relaxed);
+      std::lock_guard<std::mutex> lock(failure_lock);
+      if (!failure) {
+        failure = std::current_exception();
+      }
+    }
+#endif
+  };
+
+  if (thread_count > parts.size()) {
+    thread_count = unsigned(parts.size());
+  }
+
+  std::vector<std::thread> threads;
+#if USE_EXCEPTIONS
+  try {
+#endif
+    threads.reserve(thread_count - 1);
+    for (unsigned index = 1; index < thread_count; ++index) {
+      threads.emplace_back(parse_parts);
+    }
+#if USE_EXCEPTIONS
+  } catch (const std::exception &) {
+    // Parts are taken from the counter, so whichever threads did start
+    // still parse all of them along with this one
+  }
+#endif
+  parse_parts();
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+#if USE_EXCEPTIONS
+  if (failure) {
+    std::rethrow_exception(failure);
+  }
+#endif
+
+  // Parts before the first error parsed the same as they would have in
+  // sequence, so the first error is the one a sequential parse would report
+  for (const document_t &doc : docs) {
+    if (doc.have_error()) {
+      error_ = doc.error_;
+      return false;
+    }
+  }
+
+  merge_parts(docs);
+  return true;
+}
+
+bool document_t::parse_part(const char *source, size_t length, int options,
+                            position_t start, bool last, part_end_t *end)
+{
+  static const build_func_t build_funcs[16] = {
+    build_with<0x0>, build_with<0x1>, build_with<0x2>, build_with<0x3>,
+    build_with<0x4>, build_with<0x5>, build_with<0x6>, build_with<0x7>,
+    build_with<0x8>, build_with<0x9>, build_with<0xA>, build_with<0xB>,
+    build_with<0xC>, build_with<0xD>, build_with<0xE>, build_with<0xF>,
+  };
+
+  // Text never exceeds the source plus a terminator per name and value
+  const size_t node_count = estimate_node_count(source, length);
+  nodes_.reserve(node_count);
+  text_.reserve(length + 1 + node_count * 2);
+
+  build_funcs[options & 0xF](*this, source, length, start, last, end);
+
+  if (have_error()) {
+    clear();
+    return false;
+  }
+  return true;
+}
+
+bool document_t::select(const char *source, size_t length, const char *path,
+                        size_t path_length, int options)
+{
+  static const select_func_t select_funcs[16] = {
+    select_with<0x0>, select_with<0x1>, select_with<0x2>, select_with<0x3>,
+    select_with<0x4>, select_with<0x5>, select_with<0x6>, select_with<0x7>,
+    select_with<0x8>, select_with<0x9>, select_with<0xA>, select_with<0xB>,
+    select_with<0xC>, select_with<0xD>, select_with<0xE>, select_with<0xF>,
+  };
+
+  clear();
+  error_.clear();
+
+  if (length >= size_t(NO_NODE)) {
+    error_ = "Source is too large for a document.";
+    return false;
+  }
+
+  std::vector<selector_t::segment_t> segments;
+  const char *const path_end = path + path_length;
+  for (;;) {
+    const char *const sep =
+      (const char *)std::memchr(path, '/', size_t(path_end - path));
+    const char *const name_end = sep ? sep : path_end;
+    segments.emplace_back(path, size_t(name_end - path));
+    if (!sep) {
+      break;
+    }
+    path = sep + 1;
+  }
+
+  selector_t selector { builder_t { this }, &segments, 0, false, false };
+  select_funcs[options & 0xF](selector, source, length);
+
+  if (have_error()) {
+    clear();
+    return false;
+  }
+  index_names();
+  return true;
+}
+
+bool document_t::select(const string &source, const char *path, int options)
+{
+  return select(source.data(), size_t(source.size()), path, std::strlen(path), options);
+}
+
+bool document_t::select_file(const char *file_path, const char *path, int options)
+{
+  mapped_file_t file;
+  if (!file.open(file_path, mapped_file_t::ACCESS_SEQUENTIAL)) {
+    clear();
+    error_ = file.error();
+    return false;
+  }
+  return select(file.data(), file.size(), path, std::strlen(path), options);
+}
+
+void document_t::merge_parts(const std::vector<document_t> &docs)
+{
+  size_t node_count = 1;
+  size_t text_size = 1;
+  size_t name_count = 0;
+  for (const document_t &doc : docs) {
+    node_count += doc.nodes_.size() - 1;
+    text_size += doc.text_.size();
+    name_count += doc.names_.size();
+  }
+  nodes_.reserve(node_count);
+  text_.reserve(text_size);
+  name_tables_.reserve(node_count + 1);
+  names_.reserve(name_count);
+
+  // The root's name table is left empty until every part is in
+  name_tables_.assign(1, 0);
+
+  index_t last_top = NO_NODE;
+  for (const document_t &doc : docs) {
+    // Each part's nodes follow its root, which is dropped, so node i of the
+    // part becomes node base + i - 1 of the document
+    const index_t base = index_t(nodes_.size());
+    const size_t text_base = text_.size();
+    const auto rebase = [base] (index_t index) {
+      return (index == NO_NODE || index == ROOT) ? index : base + index - 1;
+    };
+
+    for (size_t index = 1; index < doc.nodes_.size(); ++index) {
+      node_t node = doc.nodes_[index];
+      node.parent = rebase(node.parent);
+      node.first_child = rebase(node.first_child);
+      node.next_sibling = rebase(node.next_sibling);
+      if (node.name_length > 0)
+        node.name_offset += text_base;
+      if (node.value_length > 0)
+        node.value_offset += text_base;
+      nodes_.push_back(node);
+    }
+    text_.insert(text_.end(), doc.text_.begin(), doc.text_.end());
+
+    // The part's name tables follow its root's, which is dropped as well
+    const size_t root_names = doc.name_tables_[1];
+    for (size_t index = 1; index < doc.nodes_.size(); ++index) {
+      name_tables_.push_back(doc.name_tables_[index] - root_names + names_.size());
+    }
+    for (size_t slot = root_names; slot < doc.names_.size(); ++slot) {
+      name_slot_t entry = doc.names_[slot];
+      entry.node = rebase(entry.node);
+      names_.push_back(entry);
+    }
+
+    // Chain the part's top-level nodes onto the previous part's
+    const index_t first_top = rebase(doc.nodes_[ROOT].first_child);
+    if (first_top != NO_NODE) {
+      if (last_top == NO_NODE) {
+        nodes_[ROOT].first_child = first_top;
+      } else {
+        nodes_[last_top].next_sibling = first_top;
+      }
+      last_top = rebase(doc.last_child_[0]);
+    }
+  }
+
+  last_child_[0] = last_top;
+  name_tables_.push_back(names_.size());
+  index_top_level();
+}
+
+void document_t::index_names()
+{
+  // Count each node's children and lay out tables for them in node order.
+  // Both passes go through the nodes in order, so only the tables of the
+  // ancestors of the current node are in use at a time.
+  name_tables_.assign(nodes_.size() + 1, 0);
+  for (size_t index = 1; index < nodes_.size(); ++index) {
+    name_tables_[nodes_[index].parent] += 1;
+  }
+
+  size_t slot_count = 0;
+  for (size_t &table : name_tables_) {
+    const size_t children = table;
+    table = slot_count;
+    slot_count += name_table_size(children);
+  }
+  names_.assign(slot_count, name_slot_t { NO_NODE, 0 });
+
+  // Siblings are stored in order, so the first of any sharing a name is
+  // indexed first
+  for (index_t index = 1; index < nodes_.size(); ++index) {
+    index_child(index);
+  }
+}
+
+void document_t::index_top_level()
+{
+  size_t top_count = 0;
+  for (index_t top = nodes_[ROOT].first_child; top != NO_NODE;
+       top = nodes_[top].next_sibling) {
+    top_count += 1;
+  }
+
+  // The root's table comes first, so resizing it moves every other table
+  const size_t old_size = name_tables_[1];
+  const size_t size = name_table_size(top_count);
+  if (size > old_size) {
+    names_.insert(names_.begin(), size - old_size, name_slot_t { NO_NODE, 0 });
+  } else {
+    names_.erase(names_.begin(), names_.begin() + (old_size - size));
+  }
+  for (size_t index = 1; index < name_tables_.size(); ++index) {
+    name_tables_[index] = name_tables_[index] - old_size + size;
+  }
+  std::fill(names_.begin(), names_.begin() + size, name_slot_t { NO_NODE, 0 });
+
+  for (index_t top = nodes_[ROOT].first_child; top != NO_NODE;
+       top = nodes_[top].next_sibling) {
+    index_child(top);
+  }
+}
+
+void document_t::index_child(index_t child)
+{
+  const node_t &node = nodes_[child];
+  const char *const name = &text_[node.name_offset];
+  const uint32_t hash = name_hash(name, node.name_length);
+  name_slot_t *const slot = find_name_slot(node.parent, name, node.name_length, hash);
+  if (slot->node == NO_NODE || child < slot->node) {
+    *slot = name_slot_t { child, hash };
+  }
+}
+
+document_t::name_slot_t *document_t::find_name_slot(index_t parent, const char *name,
+                                                    size_t length, uint32_t hash)
+{
+  name_slot_t *const slots = &names_[name_tables_[parent]];
+  const size_t mask = name_tables_[parent + 1] - name_tables_[parent] - 1;
+
+  size_t slot = size_t(hash) & mask;
+  for (; slots[slot].node != NO_NODE; slot = (slot + 1) & mask) {
+    const node_t &other = nodes_[slots[slot].node];
+    if (slots[slot].hash == hash && other.name_length == length &&
+        std::memcmp(&text_[other.name_offset], name, length) == 0) {
+      break;
+    }
+  }
+  return &slots[slot];
+}
+
+void document_t::remove_name_slot(index_t parent, name_slot_t *slot)
+{
+  name_slot_t *const slots = &names_[name_tables_[parent]];
+  const size_t mask = name_tables_[parent + 1] - name_tables_[parent] - 1;
+
+  // An entry after the hole can move into it if that's no earlier than the
+  // slot the entry's hash picks
+  size_t hole = size_t(slot - slots);
+  for (size_t next = (hole + 1) & mask; slots[next].node != NO_NODE;
+       next = (next + 1) & mask) {
+    const size_t home = size_t(slots[next].hash) & mask;
+    if (((next - home) & mask) >= ((next - hole) & mask)) {
+      slots[hole] = slots[next];
+      hole = next;
+    }
+  }
+  slots[hole] = name_slot_t { NO_NODE, 0 };
+}
+
+bool document_t::reparse(const char *source, size_t length, size_t edit_offset,
+                         size_t removed_length, size_t inserted_length,
+                         std::vector<change_t> &changes, int options)
+{
+  if (edit_offset > length || inserted_length > length - edit_offset) {
+    s_throw(std::invalid_argument, "Edit is outside of the source.");
+  }
+
+  changes.clear();
+  const std::vector<index_t> tops = child_nodes(*this, ROOT);
+
+  if (!tops.empty() && !have_error() && length < size_t(NO_NODE)) {
+    // The parser is between nodes at the start of each top-level node, so
+    // top-level node k can be re-parsed on its own from its start up to the
+    // start of node k + 1. The first and last nodes extend to the ends of the
+    // source. An edit touching the start of a node also re-parses the node
+    // before it, as the edit may have joined them.
+    const size_t old_length = length - inserted_length + removed_length;
+    const size_t edit_end = edit_offset + removed_length;
+    const auto node_start = [&] (size_t top) {
+      return top == 0 ? size_t(0) : nodes_[tops[top]].pos.offset;
+    };
+
+    size_t first = 0;
+    while (first + 1 < tops.size() && node_start(first + 1) < edit_offset) {
+      first += 1;
+    }
+    size_t last = first;
+    while (last + 1 < tops.size() && node_start(last + 1) <= edit_end) {
+      last += 1;
+    }
+
+    const bool at_end = last + 1 == tops.size();
+    const size_t part_start = node_start(first);
+    const size_t old_part_stop = at_end ? old_length : node_start(last + 1);
+
+    if (old_part_stop <= old_length) {
+      const size_t part_stop = old_part_stop + inserted_length - removed_length;
+      const position_t start =
+        first == 0 ? position_t { 1, 1, 0 } : nodes_[tops[first]].pos;
+
+      // Unless the part reaches the end of the source, the rest of the
+      // source only parses as before if the part ends between nodes
+      document_t part;
+      part_end_t end;
+      if (part.parse_part(source + part_start, part_stop - part_start, options,
+                          start, at_end, &end) &&
+          (at_end || end.between_nodes)) {
+        diff_nodes(*this, std::vector<index_t>(tops.begin() + first, tops.begin() + last + 1),
+                   part, child_nodes(part, ROOT), string(), tops[first], changes);
+        part.index_names();
+        splice_part(tops, first, last, part, end, inserted_length - removed_length);
+        return true;
+      }
+    }
+  }
+
+  document_t updated;
+  if (!updated.parse(source, length, options)) {
+    clear();
+    error_ = updated.error_;
+    return false;
+  }
+
+  diff_nodes(*this, tops, updated, child_nodes(updated, ROOT), string(), 1, changes);
+  *this = std::move(updated);
+  return true;
+}
+
+void document_t::splice_part(const std::vector<index_t> &tops, size_t first,
+                             size_t last, const document_t &part,
+                             const part_end_t &end, size_t offset_delta)
+{
+  const bool at_end = last + 1 == tops.size();
+  const index_t begin = tops[first];
+  const index_t stop = at_end ? index_t(nodes_.size()) : tops[last + 1];
+  const index_t added = index_t(part.nodes_.size() - 1);
+  // Added to the indices of nodes after the replaced ones (may wrap)
+  const index_t shift = added - (stop - begin);
+
+  for (index_t index = begin; index < stop; ++index) {
+    const node_t &node = nodes_[index];
+    dead_text_ += (node.name_length > 0 ? node.name_length + 1 : 0) +
+                  (node.value_length > 0 ? node.value_length + 1 : 0);
+  }
+
+  // The root's name table is updated in place unless it has to grow. The
+  // names of replaced nodes taken out of it are kept, since their text stays
+  // in the arena until compacted, to find any later siblings they hid.
+  size_t part_tops = 0;
+  for (index_t top = part.nodes_[ROOT].first_child; top != NO_NODE;
+       top = part.nodes_[top].next_sibling) {
+    part_tops += 1;
+  }
+  const bool grow_top_level =
+    name_table_size(tops.size() - (last - first + 1) + part_tops) > name_tables_[1];
+  std::vector<std::pair<size_t, size_t>> hidden_names;
+  if (!grow_top_level) {
+    for (size_t top = first; top <= last; ++top) {
+      const node_t &node = nodes_[tops[top]];
+      const char *const name = &text_[node.name_offset];
+      name_slot_t *const slot = find_name_slot(ROOT, name, node.name_length,
+                                               name_hash(name, node.name_length));
+      if (slot->node == tops[top]) {
+        remove_name_slot(ROOT, slot);
+        hidden_names.emplace_back(node.name_offset, node.name_length);
+      }
+    }
+  }
+
+  // The part's nodes follow its root, which is dropped, so node i of the part
+  // becomes node begin + i - 1 of the document
+  const size_t text_base = text_.size();
+  const auto rebase = [begin] (index_t index) {
+    return (index == NO_NODE || index == ROOT) ? index : begin + index - 1;
+  };
+
+  std::vector<node_t> replacement;
+  replacement.reserve(added);
+  for (size_t index = 1; index < part.nodes_.size(); ++index) {
+    node_t node = part.nodes_[index];
+    node.parent = rebase(node.parent);
+    node.first_child = rebase(node.first_child);
+    node.next_sibling = rebase(node.next_sibling);
+    if (node.name_length > 0)
+      node.name_offset += text_base;
+    if (node.value_length > 0)
+      node.value_offset += text_base;
+    replacement.push_back(node);
+  }
+  text_.insert(text_.end(), part.text_.begin(), part.text_.end());
+
+  const position_t old_stop_pos = at_end ? position_t { 0, 0, 0 } : nodes_[stop].pos;
+  nodes_.erase(nodes_.begin() + begin, nodes_.begin() + stop);
+  nodes_.insert(nodes_.begin() + begin, replacement.begin(), replacement.end());
+
+  // Nodes after the edit keep their text but move in the array and in the
+  // source. Only those on the line the part ended on change columns.
+  for (size_t index = size_t(begin) + added; index < nodes_.size(); ++index) {
+    node_t &node = nodes_[index];
+    if (node.parent != ROOT)
+      node.parent += shift;
+    if (node.first_child != NO_NODE)
+      node.first_child += shift;
+    if (node.next_sibling != NO_NODE)
+      node.next_sibling += shift;
+    if (node.pos.line == old_stop_pos.line)
+      node.pos.column += end.pos.column - old_stop_pos.column;
+    node.pos.line += end.pos.line - old_stop_pos.line;
+    node.pos.offset += offset_delta;
+  }
+
+  // Relink the top level around the new top-level nodes
+  const index_t next_top = at_end ? NO_NODE : stop + shift;
+  const index_t part_first = rebase(part.nodes_[ROOT].first_child);
+  const index_t part_last = rebase(part.last_child_[0]);
+  if (first == 0) {
+    nodes_[ROOT].first_child = part_first != NO_NODE ? part_first : next_top;
+  } else {
+    nodes_[tops[first - 1]].next_sibling = part_first != NO_NODE ? part_first : next_top;
+  }
+  if (part_last != NO_NODE) {
+    nodes_[part_last].next_sibling = next_top;
+  }
+
+  if (!at_end) {
+    last_child_[0] += shift;
+  } else if (part_last != NO_NODE) {
+    last_child_[0] = part_last;
+  } else {
+    last_child_[0] = first == 0 ? NO_NODE : tops[first - 1];
+  }
+
+  // Splice the part's name tables in place of the replaced nodes' in the same
+  // way, then rebuild the root's
+  const size_t names_begin = name_tables_[begin];
+  const size_t names_stop = name_tables_[stop];
+  const size_t root_names = part.name_tables_[1];
+  const size_t added_names = part.names_.size() - root_names;
+
+  std::vector<size_t> tables;
+  tables.reserve(added);
+  for (size_t index = 1; index < part.nodes_.size(); ++index) {
+    tables.push_back(part.name_tables_[index] - root_names + names_begin);
+  }
+  name_tables_.erase(name_tables_.begin() + begin, name_tables_.begin() + stop);
+  name_tables_.insert(name_tables_.begin() + begin, tables.begin(), tables.end());
+  for (size_t index = size_t(begin) + added; index < name_tables_.size(); ++index) {
+    name_tables_[index] = name_tables_[index] - (names_stop - names_begin) + added_names;
+  }
+
+  std::vector<name_slot_t> slots;
+  slots.reserve(added_names);
+  for (size_t slot = root_names; slot < part.names_.size(); ++slot) {
+    name_slot_t entry = part.names_[slot];
+    entry.node = rebase(entry.node);
+    slots.push_back(entry);
+  }
+  names_.erase(names_.begin() + names_begin, names_.begin() + names_stop);
+  names_.insert(names_.begin() + names_begin, slots.begin(), slots.end());
+  for (size_t slot = names_begin + added_names; slot < names_.size(); ++slot) {
+    if (names_[slot].node != NO_NODE)
+      names_[slot].node += shift;
+  }
+
+  if (grow_top_level) {
+    index_top_level();
+  } else {
+    for (size_t slot = 0; slot < name_tables_[1]; ++slot) {
+      if (names_[slot].node != NO_NODE && names_[slot].node >= stop)
+        names_[slot].node += shift;
+    }
+
+    index_t top = part_first;
+    for (size_t count = 0; count < part_tops; ++count, top = nodes_[top].next_sibling) {
+      index_child(top);
+    }
+
+    // Only later nodes can have been hidden, as the removed ones were indexed
+    const auto found = [this] (const std::pair<size_t, size_t> &name) {
+      const char *const str = &text_[name.first];
+      return find_name_slot(ROOT, str, name.second, name_hash(str, name.second))->node != NO_NODE;
+    };
+    hidden_names.erase(std::remove_if(hidden_names.begin(), hidden_names.end(), found),
+                       hidden_names.end());
+    for (top = next_top; top != NO_NODE && !hidden_names.empty();
+         top = nodes_[top].next_sibling) {
+      const node_t &node = nodes_[top];
+      const auto same_name = [&] (const std::pair<size_t, size_t> &name) {
+        return name.second == node.name_length &&
+               std::memcmp(&text_[name.first], &text_[node.name_offset], name.second) == 0;
+      };
+      const auto hidden = std::find_if(hidden_names.begin(), hidden_names.end(), same_name);
+      if (hidden != hidden_names.end()) {
+        index_child(top);
+        hidden_names.erase(hidden);
+      }
+    }
+  }
+
+  // Keep the arena from growing without bound over many edits
+  if (dead_text_ > text_.size() / 2) {
+    compact_text();
+  }
+}
+
+void document_t::compact_text()
+{
+  std::vector<char> text;
+  text.reserve(text_.size() - std::min(dead_text_, text_.size()));
+  text.push_back('\0');
+
+  const auto move_text = [&] (size_t &offset, size_t length) {
+    if (length > 0) {
+      const size_t new_offset = text.size();
+      text.insert(text.end(), text_.begin() + offset, text_.begin() + offset + length + 1);
+      offset = new_offset;
+    }
+  };
+
+  for (node_t &node : nodes_) {
+    move_text(node.name_offset, node.name_length);
+    move_text(node.value_offset, node.value_length);
+  }
+
+  text_.swap(text);
+  dead_text_ = 0;
+}
+
+bool document_t::parse(const string &source, int options)
+{
+  return parse(source.data(), size_t(source.size()), options);
+}
+
+bool document_t::parse_file(const char *path, int options)
+{
+  mapped_file_t file;
+  if (!file.open(path, mapped_file_t::ACCESS_SEQUENTIAL)) {
+    clear();
+    error_ = file.error();
+    return false;
+  }
+  return parse(file.data(), file.size(), options);
+}
+
+void document_t::clear()
+{
+  node_t root;
+  root.parent = NO_NODE;
+  root.first_child = NO_NODE;
+  root.next_sibling = NO_NODE;
+  root.branch = true;
+  root.name_offset = 0;
+  root.name_length = 0;
+  root.value_offset = 0;
+  root.value_length = 0;
+  root.pos = { 1, 1, 0 };
+
+  nodes_.clear();
+  nodes_.push_back(root);
+  text_.clear();
+  text_.push_back('\0');
+  dead_text_ = 0;
+  name_tables_.assign(2, 0);
+  names_.clear();
+  open_.assign(1, ROOT);
+  last_child_.assign(1, NO_NODE);
+}
+
+size_t document_t::add_text(const char *str, size_t length)
+{
+  if (length == 0) {
+    return 0;
+  }
+  const size_t offset = text_.size();
+  text_.insert(text_.end(), str, str + length);
+  text_.push_back('\0');
+  return offset;
+}
+
+document_t::index_t document_t::find_child(index_t parent, const char *name,
+                                             size_t length) const
+{
+  return find_child_node(*this, name_tables_.data(), names_.data(), parent, name,
+                         length);
+}
+
+document_t::index_t document_t::find(const char *path, size_t length,
+                                       index_t from) const
+{
+  return find_path(*this, name_tables_.data(), names_.data(), path, length, from);
+}
+
+document_t::index_t document_t::find(const string &path, index_t from) const
+{
+  return find(path.data(), size_t(path.size()), from);
+}
+
+document_t::index_t document_t::find(const char *path, index_t from) const
+{
+  return find(path, std::strlen(path), from);
+}
+
+
+size_t document_t::compiled_size() const
+{
+  if (text_.size() >= size_t(UINT32_MAX) || names_.size() >= size_t(UINT32_MAX)) {
+    return 0;
+  }
+  return sizeof(image_header_t) +
+         nodes_.size() * sizeof(compiled_document_t::node_t) +
+         name_tables_.size() * sizeof(uint32_t) +
+         names_.size() * sizeof(name_slot_t) +
+         text_.size();
+}
+
+size_t document_t::compile(buffer_stream_t &out) const
+{
+  using compiled_node_t = compiled_document_t::node_t;
+
+  const size_t size = compiled_size();
+  if (size == 0 || out.remainder() < size) {
+    return 0;
+  }
+
+  const image_header_t header {
+    DOC_IMAGE_MAGIC, compiled_document_t::VERSION, uint32_t(nodes_.size()),
+    uint32_t(sizeof(compiled_node_t)), uint64_t(text_.size()),
+    uint64_t(names_.size())
+  };
+  out.write(&header, sizeof(header));
+
+  for (const node_t &node : nodes_) {
+    const compiled_node_t compiled {
+      node.parent, node.first_child, node.next_sibling, node.branch ? 1U : 0U,
+      uint32_t(node.name_offset), uint32_t(node.name_length),
+      uint32_t(node.value_offset), uint32_t(node.value_length),
+      uint32_t(std::min<size_t>(node.pos.line, UINT32_MAX)),
+      uint32_t(std::min<size_t>(node.pos.column, UINT32_MAX))
+    };
+    out.write(&compiled, sizeof(compiled));
+  }
+
+  for (const size_t table : name_tables_) {
+    const uint32_t offset = uint32_t(table);
+    out.write(&offset, sizeof(offset));
+  }
+  if (!names_.empty()) {
+    out.write(names_.data(), names_.size() * sizeof(name_slot_t));
+  }
+  out.write(text_.data(), text_.size());
+  return size;
+}
+
+bool document_t::compile_file(const char *path) const
+{
+  std::vector<char> image(compiled_size());
+  buffer_stream_t out(image.data(), image.size());
+  if (image.empty() || compile(out) != image.size()) {
+    return false;
+  }
+
+  FILE *const file = std::fopen(path, "wb");
+  if (!file) {
+    return false;
+  }
+  const bool written = std::fwrite(image.data(), 1, image.size(), file) == image.size();
+  return (std::fclose(file) == 0) && written;
+}
+
+
+
+/// compiled_document_t
+
+const compiled_document_t::index_t compiled_document_t::NO_NODE;
+const compiled_document_t::index_t compiled_document_t::ROOT;
+const uint32_t compiled_document_t::VERSION;
+
+compiled_document_t::compiled_document_t()
+{
+  clear();
+}
+
+compiled_document_t::compiled_document_t(compiled_document_t &&other) :
+  file_(std::move(other.file_)), nodes_(other.nodes_),
+  node_count_(other.node_count_), name_tables_(other.name_tables_),
+  names_(other.names_), name_slots_(other.name_slots_), text_(other.text_),
+  text_size_(other.text_size_), error_(std::move(other.error_))
+{
+  other.clear();
+}
+
+compiled_document_t &compiled_document_t::operator = (compiled_document_t &&other)
+{
+  if (this != &other) {
+    file_ = std::move(other.file_);
+    nodes_ = other.nodes_;
+    node_count_ = other.node_count_;
+    name_tables_ = other.name_tables_;
+    names_ = other.names_;
+    name_slots_ = other.name_slots_;
+    text_ = other.text_;
+    text_size_ = other.text_size_;
+    error_ = std::move(other.error_);
+    other.clear();
+  }
+  return *this;
+}
+
+bool compiled_document_t::load_file(const char *path)
+{
+  clear();
+  mapped_file_t file;
+  if (!file.open(path, mapped_file_t::ACCESS_RANDOM)) {
+    error_ = file.error();
+    return false;
+  } else if (!load(file.data(), file.size())) {
+    return false;
+  }
+  file_ = std::move(file);
+  return true;
+}
+
+bool compiled_document_t::load(const void *data, size_t length)
+{
+  clear();
+
+  image_header_t header;
+  if (length < sizeof(header)) {
+    error_ = "Image is too small.";
+    return false;
+  }
+  std::memcpy(&header, data, sizeof(header));
+
+  if (header.magic != DOC_IMAGE_MAGIC) {
+    error_ = "Not a compiled Sparse document, or compiled for a host of different endianness.";
+    return false;
+  } else if (header.version != VERSION || header.node_size != sizeof(node_t)) {
+    error_ = "Unsupported compiled Sparse document version.";
+    return false;
+  } else if (uintptr_t(data) % alignof(node_t) != 0) {
+    error_ = "Image is misaligned.";
+    return false;
+  }
+
+  const size_t nodes_size = size_t(header.node_count) * sizeof(node_t);
+  const size_t index_size = (size_t(header.node_count) + 1) * sizeof(uint32_t) +
+                            size_t(header.name_slots) * sizeof(document_t::name_slot_t);
+  if (header.node_count == 0 ||
+      header.text_size == 0 ||
+      header.name_slots > length / sizeof(document_t::name_slot_t) ||
+      length - sizeof(header) < nodes_size ||
+      length - sizeof(header) - nodes_size < index_size ||
+      length - sizeof(header) - nodes_size - index_size < header.text_size) {
+    error_ = "Image is truncated or corrupt.";
+    return false;
+  }
+
+  const char *const image = (const char *)data + sizeof(header);
+  nodes_ = (const node_t *)image;
+  node_count_ = header.node_count;
+  name_tables_ = (const uint32_t *)(image + nodes_size);
+  names_ = (const document_t::name_slot_t *)(name_tables_ + node_count_ + 1);
+  name_slots_ = size_t(header.name_slots);
+  text_ = image + nodes_size + index_size;
+  text_size_ = size_t(header.text_size);
+  return true;
+}
+
+void compiled_document_t::clear()
+{
+  file_.close();
+  nodes_ = &DOC_EMPTY_ROOT;
+  node_count_ = 1;
+  name_tables_ = DOC_EMPTY_NAME_TABLES;
+  names_ = nullptr;
+  name_slots_ = 0;
+  text_ = DOC_EMPTY_TEXT;
+  text_size_ = sizeof(DOC_EMPTY_TEXT);
+  error_.clear();
+}
+
+bool compiled_document_t::verify() const
+{
+  // Text must end in a NUL so that no name or value can run past it
+  if (text_[text_size_ - 1] != '\0' || nodes_[ROOT].parent != NO_NODE) {
+    return false;
+  }
+
+  for (size_t index = 0; index < node_count_; ++index) {
+    const node_t &node = nodes_[index];
+    const bool links_in_bounds =
+      (index == ROOT || node.parent < index) &&
+      (node.first_child == NO_NODE ||
+       (node.first_child > index && node.first_child < node_count_ &&
+        nodes_[node.first_child].parent == index)) &&
+      (node.next_sibling == NO_NODE ||
+       (node.next_sibling > index && node.next_sibling < node_count_ &&
+        nodes_[node.next_sibling].parent == node.parent));
+    const bool text_in_bounds =
+      node.name_offset < text_size_ &&
+      node.name_length < text_size_ - node.name_offset &&
+      node.value_offset < text_size_ &&
+      node.value_length < text_size_ - node.value_offset;
+    if (!links_in_bounds || !text_in_bounds) {
+      return false;
+    }
+  }
+
+  // Lookups probe a table until they reach a free slot, so every non-empty
+  // table needs one
+  if (name_tables_[0] != 0 || name_tables_[node_count_] != name_slots_) {
+    return false;
+  }
+  for (size_t index = 0; index < node_count_; ++index) {
+    const uint32_t begin = name_tables_[index];
+    const uint32_t end = name_tables_[index + 1];
+    if (end < begin || ((end - begin) & (end - begin - 1)) != 0) {
+      return false;
+    }
+
+    bool have_free_slot = begin == end;
+    for (uint32_t slot = begin; slot < end; ++slot) {
+      const uint32_t child = names_[slot].node;
+      if (child == NO_NODE) {
+        have_free_slot = true;
+      } else if (child >= node_count_ || nodes_[child].parent != index) {
+        return false;
+      }
+    }
+    if (!have_free_slot) {
+      return false;
+    }
+  }
+
+  return true;
+}
+
+compiled_document_t::index_t compiled_document_t::find_child(
+  index_t parent, const char *name, size_t length) const
+{
+  return find_child_node(*this, name_tables_, names_, parent, name, length);
+}
+
+compiled_document_t::index_t compiled_document_t::find(
+  const char *path, size_t length, index_t from) const
+{
+  return find_path(*this, name_tables_, names_, path, length, from);
+}
+
+compiled_document_t::index_t compiled_document_t::find(const string &path,
+                                                       index_t from) const
+{
+  return find(path.data(), size_t(path.size()), from);
+}
+
+compiled_document_t::index_t compiled_document_t::find(const char *path,
+                                                       index_t from) const
+{
+  return find(path, std::strlen(path), from);
+}
+
+
+} // namespace sparse
+} // namespace snow
@@ -0,0 +1,439 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#include "snow/data/sparse_value.hh"
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <locale.h>
+#if S_PLATFORM_APPLE
+#include <xlocale.h>
+#endif
+
+namespace snow {
+namespace sparse {
+
+/// Static function declarations
+namespace {
+
+// A decimal number, as its leading significant digits and the power of ten
+// they're scaled by.
+struct decimal_t
+{
+  uint64_t digits;
+  int64_t  exponent;
+  bool     negative;
+  // Whether any non-zero digits didn't fit in digits.
+  bool     truncated;
+};
+
+// Reads the digits of an unsigned integer. Returns false if there are none,
+// if anything else follows them, or if the integer is over max.
+bool read_digits(const char *str, const char *end, uint64_t max, uint64_t &out);
+// Reads a decimal number. Returns false if there isn't exactly one.
+bool read_decimal(const char *str, const char *end, decimal_t &out);
+// Converts a decimal number to the nearest double if that can be done exactly
+// with a single floating point operation. Returns false otherwise.
+bool convert_exact(const decimal_t &decimal, double &out);
+// Returns whether value lies exactly halfway between two floats, nearest
+// being the one it converts to.
+bool is_float_midpoint(double value, float nearest);
+// Copies a decimal number to out as its first SP_MAX_SIGNIFICANT_DIGITS
+// significant digits and an exponent, keeping its value exact enough to
+// round correctly. Returns the length written.
+size_t compact_decimal(const char *str, const char *end, char *out);
+// Reads a decimal number with strtod_l (or strtof_l) in the C locale. Slower
+// than convert_exact, but handles any decimal number.
+template <typename T>
+bool read_locale_independent(const char *str, size_t length, T &out);
+// Compares a value to a lowercase word, ignoring the value's case.
+bool equal_word(const char *str, size_t length, const char *word);
+// Returns the C locale.
+locale_t c_locale();
+
+
+
+/// Constants
+
+// Most significant digits kept by read_decimal -- as many as always fit in
+// 64 bits.
+const int SP_MAX_DECIMAL_DIGITS = 19;
+// Exponents past this are clamped, being far out of range of a double anyway.
+const int64_t SP_MAX_DECIMAL_EXPONENT = 100000;
+
+// Integers up to this are exact as doubles.
+const uint64_t SP_MAX_EXACT_DIGITS = uint64_t(1) << 53;
+// Powers of ten that are exact as doubles.
+const double SP_EXACT_POWERS_OF_TEN[] = {
+  1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+const int64_t SP_MAX_EXACT_EXPONENT = 22;
+
+// Significant digits needed to round any decimal number correctly to a
+// double -- as many as the longest exact halfway point between two doubles.
+const size_t SP_MAX_SIGNIFICANT_DIGITS = 768;
+// Longest value read_locale_independent will copy as-is to terminate. Longer
+// values are compacted, which never takes more than this.
+const size_t SP_MAX_NUMBER_LENGTH = SP_MAX_SIGNIFICANT_DIGITS + 32;
+
+// Whether double arithmetic rounds each operation to double, which
+// convert_exact relies on. Not so for x87 code, which rounds to extended
+// precision first.
+#if defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+const bool SP_DOUBLE_ROUNDING_EXACT = true;
+#else
+const bool SP_DOUBLE_ROUNDING_EXACT = false;
+#endif
+
+
+
+/// Static function definitions
+
+bool read_digits(const char *str, const char *end, uint64_t max, uint64_t &out)
+{
+  unsigned base = 10;
+  if (end - str > 2 && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+    base = 16;
+    str += 2;
+  }
+  if (str == end) {
+    return false;
+  }
+
+  uint64_t value = 0;
+  for (; str < end; ++str) {
+    unsigned digit;
+    const char ch = *str;
+    if (ch >= '0' && ch <= '9') {
+      digit = unsigned(ch - '0');
+    } else if (base == 16 && ch >= 'a' && ch <= 'f') {
+      digit = unsigned(ch - 'a' + 10);
+    } else if (base == 16 && ch >= 'A' && ch <= 'F') {
+      digit = unsigned(ch - 'A' + 10);
+    } else {
+      return false;
+    }
+    if (value > (max - digit) / base) {
+      return false;
+    }
+    value = value * base + digit;
+  }
+
+  out = value;
+  return true;
+}
+
+bool read_decimal(const char *str, const char *end, decimal_t &out)
+{
+  out.digits = 0;
+  out.exponent = 0;
+  out.negative = str < end && *str == '-';
+  out.truncated = false;
+  if (str < end && (*str == '-' || *str == '+')) {
+    ++str;
+  }
+
+  // Leading zeros aren't significant, so they aren't counted against the
+  // digits kept. Digits past those are only noted if they're non-zero.
+  int kept = 0;
+  bool any_digits = false;
+  bool fraction = false;
+  for (; str < end; ++str) {
+    const char ch = *str;
+    if (ch == '.' && !fraction) {
+      fraction = true;
+      continue;
+    } else if (ch < '0' || ch > '9') {
+      break;
+    }
+
+    const unsigned digit = unsigned(ch - '0');
+    any_digits = true;
+    if (kept < SP_MAX_DECIMAL_DIGITS && (kept > 0 || digit != 0)) {
+      out.digits = out.digits * 10 + digit;
+      kept += 1;
+      out.exponent -= fraction;
+    } else if (kept == 0) {
+      out.exponent -= fraction;
+    } else {
+      out.exponent += !fraction;
+      out.truncated = out.truncated || digit != 0;
+    }
+  }
+
+  if (!any_digits) {
+    return false;
+  } else if (str < end && (*str == 'e' || *str == 'E')) {
+    ++str;
+    const bool negative = str < end && *str == '-';
+    if (str < end && (*str == '-' || *str == '+')) {
+      ++str;
+    }
+    if (str == end) {
+      return false;
+    }
+
+    int64_t exponent = 0;
+    for (; str < end && *str >= '0' && *str <= '9'; ++str) {
+      if (exponent < SP_MAX_DECIMAL_EXPONENT) {
+        exponent = exponent * 10 + (*str - '0');
+      }
+    }
+    out.exponent += negative ? -exponent : exponent;
+  }
+
+  return str == end;
+}
+
+bool convert_exact(const decimal_t &decimal, double &out)
+{
+  // Both the digits and the power of ten are exact as doubles, so a single
+  // multiplication or division rounds correctly (Clinger's fast path).
+  uint64_t digits = decimal.digits;
+  int64_t exponent = decimal.exponent;
+  if (!SP_DOUBLE_ROUNDING_EXACT || decimal.truncated || digits > SP_MAX_EXACT_DIGITS) {
+    return false;
+  } else if (digits == 0) {
+    out = decimal.negative ? -0.0 : 0.0;
+    return true;
+  }
+
+  // Move any excess powers of ten into the digits, if they stay exact
+  for (; exponent > SP_MAX_EXACT_EXPONENT; --exponent) {
+    if (digits > SP_MAX_EXACT_DIGITS / 10) {
+      return false;
+    }
+    digits *= 10;
+  }
+
+  double value;
+  if (exponent >= 0) {
+    value = double(digits) * SP_EXACT_POWERS_OF_TEN[exponent];
+  } else if (exponent >= -SP_MAX_EXACT_EXPONENT) {
+    value = double(digits) / SP_EXACT_POWERS_OF_TEN[-exponent];
+  } else {
+    return false;
+  }
+
+  out = decimal.negative ? -value : value;
+  return true;
+}
+
+bool is_float_midpoint(double value, float nearest)
+{
+  if (double(nearest) == value) {
+    return false;
+  }
+  const float toward = value > double(nearest) ? std::numeric_limits<float>::infinity()
+                                               : -std::numeric_limits<float>::infinity();
+  const float other = std::nextafter(nearest, toward);
+  return value - double(nearest) == double(other) - value;
+}
+
+size_t compact_decimal(const char *str, const char *end, char *out)
+{
+  char *cursor = out;
+  if (str < end && (*str == '-' || *str == '+')) {
+    if (*str == '-') {
+      *cursor++ = '-';
+    }
+    ++str;
+  }
+
+  // As in read_decimal, except that digits past those kept only matter if
+  // they're non-zero, in which case a single 1 stands in for all of them.
+  // That's enough to tell which side of a halfway point the value is on.
+  size_t kept = 0;
+  int64_t exponent = 0;
+  bool fraction = false;
+  bool truncated = false;
+  for (; str < end; ++str) {
+    const char ch = *str;
+    if (ch == '.') {
+      fraction = true;
+      continue;
+    } else if (ch < '0' || ch > '9') {
+      break;
+    }
+
+    if (kept < SP_MAX_SIGNIFICANT_DIGITS && (kept > 0 || ch != '0')) {
+      *cursor++ = ch;
+      kept += 1;
+      exponent -= fraction;
+    } else if (kept == 0) {
+      exponent -= fraction;
+    } else {
+      exponent += !fraction;
+      truncated = truncated || ch != '0';
+    }
+  }
+
+  if (kept == 0) {
+    *cursor++ = '0';
+  } else if (truncated) {
+    *cursor++ = '1';
+    exponent -= 1;
+  }
+
+  if (str < end && (*str == 'e' || *str == 'E')) {
+    ++str;
+    const bool negative = str < end && *str == '-';
+    if (str < end && (*str == '-' || *str == '+')) {
+      ++str;
+    }
+    int64_t explicit_exponent = 0;
+    for (; str < end && *str >= '0' && *str <= '9'; ++str) {
+      if (explicit_exponent < SP_MAX_DECIMAL_EXPONENT) {
+        explicit_exponent = explicit_exponent * 10 + (*str - '0');
+      }
+    }
+    exponent += negative ? -explicit_exponent : explicit_exponent;
+  }
+
+  cursor += std::sprintf(cursor, "e%lld", (long long)exponent);
+  return size_t(cursor - out);
+}
+
+template <typename T>
+bool read_locale_independent(const char *str, size_t length, T &out)
+{
+  // strtod_l needs a terminated string
+  char number[SP_MAX_NUMBER_LENGTH + 1];
+  if (length > SP_MAX_NUMBER_LENGTH) {
+    length = compact_decimal(str, str + length, number);
+  } else {
+    std::memcpy(number, str, length);
+    number[length] = '\0';
+  }
+
+  char *number_end;
+  const T value = std::is_same<T, float>::value
+                  ? T(strtof_l(number, &number_end, c_locale()))
+                  : T(strtod_l(number, &number_end, c_locale()));
+  // The value has been checked already, so infinity means it's out of range
+  if (number_end != number + length || std::isinf(value)) {
+    return false;
+  }
+  out = value;
+  return true;
+}
+
+bool equal_word(const char *str, size_t length, const char *word)
+{
+  for (size_t index = 0; index < length; ++index) {
+    const char ch = str[index];
+    const char lower = (ch >= 'A' && ch <= 'Z') ? char(ch - 'A' + 'a') : ch;
+    if (word[index] == '\0' || lower != word[index]) {
+      return false;
+    }
+  }
+  return word[length] == '\0';
+}
+
+locale_t c_locale()
+{
+  static const locale_t locale = newlocale(LC_ALL_MASK, "C", locale_t(0));
+  return locale;
+}
+
+} // anonymous namespace
+
+
+
+/// Values
+
+bool read_value(const char *str, size_t length, int64_t &out)
+{
+  const char *const end = str + length;
+  const bool negative = length > 0 && str[0] == '-';
+  if (length > 0 && (str[0] == '-' || str[0] == '+')) {
+    str += 1;
+  }
+
+  // The magnitude of the most negative value is one more than the maximum
+  const uint64_t max = uint64_t(INT64_MAX) + (negative ? 1 : 0);
+  uint64_t magnitude;
+  if (!read_digits(str, end, max, magnitude)) {
+    return false;
+  }
+  out = negative ? int64_t(0 - magnitude) : int64_t(magnitude);
+  return true;
+}
+
+bool read_value(const char *str, size_t length, uint64_t &out)
+{
+  if (length > 0 && str[0] == '+') {
+    str += 1;
+    length -= 1;
+  }
+  return read_digits(str, str + length, UINT64_MAX, out);
+}
+
+bool read_value(const char *str, size_t length, double &out)
+{
+  decimal_t decimal;
+  if (read_decimal(str, str + length, decimal)) {
+    return convert_exact(decimal, out) ||
+           read_locale_independent(str, length, out);
+  }
+
+  const bool negative = length > 0 && str[0] == '-';
+  if (length > 0 && (str[0] == '-' || str[0] == '+')) {
+    str += 1;
+    length -= 1;
+  }
+  if (equal_word(str, length, "inf") || equal_word(str, length, "infinity")) {
+    out = negative ? -HUGE_VAL : HUGE_VAL;
+  } else if (equal_word(str, length, "nan")) {
+    out = negative ? -NAN : NAN;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+bool read_value(const char *str, size_t length, float &out)
+{
+  double value;
+  if (!read_value(str, length, value)) {
+    return false;
+  }
+
+  // The nearest double rounds to the nearest float unless it's halfway
+  // between two floats, in which case the digits past it decide
+  const float nearest = float(value);
+  if (std::isinf(nearest) && !std::isinf(value)) {
+    return false;
+  } else if (is_float_midpoint(value, nearest)) {
+    return read_locale_independent(str, length, out);
+  }
+  out = nearest;
+  return true;
+}
+
+bool read_value(const char *str, size_t length, bool &out)
+{
+  if (equal_word(str, length, "true") || equal_word(str, length, "yes") ||
+      equal_word(str, length, "on") || equal_word(str, length, "1")) {
+    out = true;
+  } else if (equal_word(str, length, "false") || equal_word(str, length, "no") ||
+             equal_word(str, length, "off") || equal_word(str, length, "0")) {
+    out = false;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+
+} // namespace sparse
+} // namespace snow
@@ -0,0 +1,255 @@
+/*
+ * Copyright Noel Cower 2014.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#include "snow/data/sparse_writer.hh"
+#include <cstring>
+#include <stdexcept>
+#include <utility>
+
+namespace snow {
+namespace sparse {
+
+/// Static function declarations
+namespace {
+
+// Appends str to out, escaped so that it reads back as a single name (if
+// NAME) or value.
+template <bool NAME>
+void append_escaped(std::vector<char> &out, const char *str, size_t length);
+// Appends the whitespace between a name and its value or '{'.
+void append_separator(std::vector<char> &out);
+
+
+
+/// Constants
+
+const size_t SP_WRITER_INIT_CAPACITY = 4096;
+const size_t SP_WRITER_DEFAULT_INDENT = 2;
+
+
+
+/// Static function definitions
+
+template <bool NAME>
+void append_escaped(std::vector<char> &out, const char *str, size_t length)
+{
+  const char *const begin = str;
+  const char *const end = str + length;
+
+  while (str < end) {
+    // Copy everything up to the next character that might need escaping
+    const char *const run_end = find_structural(str, end);
+    out.insert(out.end(), str, run_end);
+    if (run_end == end) {
+      break;
+    }
+
+    const char ch = *run_end;
+    switch (ch) {
+    case ' ':
+      // Spaces end names, and in values they're skipped at the start, may be
+      // trimmed at the end, and may be consumed if they follow another space.
+      if (NAME || run_end == begin || run_end + 1 == end || out.back() == ' ') {
+        out.push_back('\\');
+      }
+      out.push_back(' ');
+      break;
+    case '\t': out.push_back('\\'); out.push_back('t'); break;
+    case '\n': out.push_back('\\'); out.push_back('n'); break;
+    default:   out.push_back('\\'); out.push_back(ch); break;
+    }
+
+    str = run_end + 1;
+  }
+}
+
+void append_separator(std::vector<char> &out)
+{
+  // A space right after a name ending in an escaped space would be consumed
+  // along with it, so use a tab there instead.
+  out.push_back(out.back() == ' ' ? '\t' : ' ');
+}
+
+} // anonymous namespace
+
+
+
+/// writer_t
+
+const size_t writer_t::DEFAULT_FLUSH_SIZE;
+
+writer_t::writer_t() :
+  writer_t(flush_func_t())
+{
+  /* nop */
+}
+
+writer_t::writer_t(flush_func_t flush, size_t flush_size) :
+  flush_(std::move(flush)),
+  flush_size_(flush_size),
+  indent_width_(SP_WRITER_DEFAULT_INDENT),
+  indent_char_(' '),
+  depth_(0),
+  failed_(false),
+  have_name_(false)
+{
+  buffer_.reserve(flush_ ? flush_size_ + SP_WRITER_INIT_CAPACITY : SP_WRITER_INIT_CAPACITY);
+}
+
+writer_t::~writer_t()
+{
+  flush();
+}
+
+void writer_t::set_indent(size_t width, char ch)
+{
+  if (ch != ' ' && ch != '\t') {
+    s_throw(std::invalid_argument, "Indentation must be spaces or tabs.");
+  }
+  indent_width_ = width;
+  indent_char_ = ch;
+}
+
+void writer_t::open(const char *name, size_t length)
+{
+  write_indent();
+  if (length > 0) {
+    append_escaped<true>(buffer_, name, length);
+    append_separator(buffer_);
+  }
+  buffer_.push_back('{');
+  buffer_.push_back('\n');
+  depth_ += 1;
+  flush_if_full();
+}
+
+void writer_t::open(const string &name)
+{
+  open(name.data(), size_t(name.size()));
+}
+
+void writer_t::open(const char *name)
+{
+  open(name, std::strlen(name));
+}
+
+void writer_t::close()
+{
+  if (depth_ == 0) {
+    s_throw(std::logic_error, "Attempt to close node when no node is open.");
+  }
+  depth_ -= 1;
+  write_indent();
+  buffer_.push_back('}');
+  buffer_.push_back('\n');
+  flush_if_full();
+}
+
+void writer_t::value(const char *name, size_t name_length,
+                     const char *value, size_t value_length)
+{
+  if (name_length == 0) {
+    s_throw(std::invalid_argument, "Attempt to write a value without a name.");
+  }
+  write_indent();
+  append_escaped<true>(buffer_, name, name_length);
+  if (value_length > 0) {
+    append_separator(buffer_);
+    append_escaped<false>(buffer_, value, value_length);
+  }
+  buffer_.push_back('\n');
+  flush_if_full();
+}
+
+void writer_t::value(const string &name, const string &value)
+{
+  this->value(name.data(), size_t(name.size()), value.data(), size_t(value.size()));
+}
+
+void writer_t::value(const char *name, const char *value)
+{
+  this->value(name, std::strlen(name), value, std::strlen(value));
+}
+
+void writer_t::token(source_kind_t kind, const char *str, size_t length)
+{
+  switch (kind) {
+  case SP_NAME:
+    name_.assign(str, str + length);
+    have_name_ = true;
+    break;
+
+  case SP_VALUE:
+  case SP_OPEN_NODE:
+    if (!have_name_) {
+      s_throw(std::logic_error, "Attempt to write a node before its name.");
+    }
+    have_name_ = false;
+    if (kind == SP_VALUE) {
+      value(name_.data(), name_.size(), str, length);
+    } else {
+      open(name_.data(), name_.size());
+    }
+    break;
+
+  case SP_CLOSE_NODE:
+    close();
+    break;
+
+  case SP_DONE:
+    finish();
+    break;
+
+  default: break;
+  }
+}
+
+bool writer_t::finish()
+{
+  while (depth_ > 0) {
+    close();
+  }
+  have_name_ = false;
+  return flush() && !failed_;
+}
+
+bool writer_t::flush()
+{
+  if (!flush_ || buffer_.empty()) {
+    return true;
+  }
+  const bool flushed = flush_(buffer_.data(), buffer_.size());
+  failed_ = failed_ || !flushed;
+  buffer_.clear();
+  return flushed;
+}
+
+void writer_t::clear()
+{
+  buffer_.clear();
+  depth_ = 0;
+  failed_ = false;
+  have_name_ = false;
+}
+
+void writer_t::write_indent()
+{
+  buffer_.insert(buffer_.end(), depth_ * indent_width_, indent_char_);
+}
+
+void writer_t::flush_if_full()
+{
+  if (flush_ && buffer_.size() >= flush_size_) {
+    flush();
+  }
+}
+
+
+} // namespace sparse
+} // namespace snow
@@ -0,0 +1,355 @@
+/*
+ * Copyright Noel Cower 2013.
+ *
+ * Distributed under the Boost Software License, Version 1.0.
+ * (See accompanying file LICENSE_1_0.txt or copy at
+ *  http://www.boost.org/LICENSE_1_0.txt)
+ */
+
+
+#include <snow/string/atom_table.hh>
+#include <snow/data/hash.hh>
+#include <snow/types/flat_hash_map.hh>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+
+namespace snow {
+
+
+namespace {
+
+
+/// Arena
+
+// Size of each arena chunk. Strings longer than a quarter of this get a chunk
+// of their own so that they don't waste the remainder of a shared chunk.
+const size_t ATOM_CHUNK_SIZE = 16384;
+const size_t ATOM_LARGE_SIZE = ATOM_CHUNK_SIZE / 4;
+
+// Shift of the shard index out of the hash in a thread-safe table -- the top
+// bits are used since the flat hash set uses the low bits.
+const uint32_t ATOM_SHARD_BITS = 4;
+static_assert((size_t(1) << ATOM_SHARD_BITS) == atom_table_t::SHARD_COUNT,
+              "SHARD_COUNT must be 2^ATOM_SHARD_BITS");
+
+
+
+struct atom_entry_t
+{
+  const char *str;
+  size_t      length;
+  uint64_t    hash;
+};
+
+using atom_entries_t = std::vector<atom_entry_t>;
+
+
+
+/// Lookup
+
+// A string being looked up in a shard, hashed once up front.
+struct atom_lookup_t
+{
+  const char *str;
+  size_t      length;
+  uint64_t    hash;
+};
+
+
+
+// The shard's index holds entry indices, so both the hasher and the equality
+// functor look through to the shard's entries.
+struct atom_hash_t
+{
+  const atom_entries_t *entries;
+
+  uint64_t operator () (uint32_t index) const
+  {
+    return (*entries)[index].hash;
+  }
+
+  uint64_t operator () (const atom_lookup_t &key) const
+  {
+    return key.hash;
+  }
+};
+
+
+
+struct atom_equal_t
+{
+  const atom_entries_t *entries;
+
+  bool operator () (uint32_t lhs, uint32_t rhs) const
+  {
+    return lhs == rhs;
+  }
+
+  bool operator () (uint32_t index, const atom_lookup_t &key) const
+  {
+    const atom_entry_t &entry = (*entries)[index];
+    return entry.hash == key.hash &&
+           entry.length == key.length &&
+           std::memcmp(entry.str, key.str, key.length) == 0;
+  }
+};
+
+using atom_index_t = flat_hash_set_t<uint32_t, atom_hash_t, atom_equal_t>;
+
+
+} // namespace <anon>
+
+
+
+struct atom_table_t::shard_t
+{
+  shard_t() :
+    index(0, atom_hash_t { &entries }, atom_equal_t { &entries }),
+    chunk_used(ATOM_CHUNK_SIZE)
+  {
+    /* nop */
+  }
+
+  const char *store(const char *str, size_t length);
+
+  mutable std::mutex                   lock;
+  atom_entries_t                       entries;
+  atom_index_t                         index;
+  std::vector<std::unique_ptr<char[]>> chunks;
+  size_t                               chunk_used;
+};
+
+
+
+/*==============================================================================
+  shard_t::store(str, length)
+
+    Copies the string into the shard's arena, NUL-terminated, and returns the
+    copy.
+==============================================================================*/
+const char *atom_table_t::shard_t::store(const char *str, size_t length)
+{
+  const size_t size = length + 1;
+  char *copy;
+
+  if (size > ATOM_LARGE_SIZE) {
+    // Insert before the current chunk so its remaining space stays usable.
+    std::unique_ptr<char[]> large(new char[size]);
+    copy = large.get();
+    if (chunks.empty()) {
+      chunks.push_back(std::move(large));
+    } else {
+      chunks.insert(chunks.end() - 1, std::move(large));
+    }
+  } else {
+    if (ATOM_CHUNK_SIZE - chunk_used < size) {
+      chunks.emplace_back(new char[ATOM_CHUNK_SIZE]);
+      chunk_used = 0;
+    }
+    copy = chunks.back().get() + chunk_used;
+    chunk_used += size;
+  }
+
+  std::memcpy(copy, str, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+
+
+/*==============================================================================
+  atom_table_t(thread_safe)
+
+    A table that isn't thread-safe has a single shard and uses no shard bits,
+    so its atoms are plain entry indices.
+==============================================================================*/
+atom_table_t::atom_table_t(bool thread_safe) :
+  shard_bits_(thread_safe ? ATOM_SHARD_BITS : 0),
+  shards_(new shard_t[size_t(1) << shard_bits_])
+{
+  /* nop */
+}
+
+
+
+atom_table_t::~atom_table_t()
+{
+  /* nop */
+}
+
+
+
+/*==============================================================================
+  intern(str, length)
+
+    Returns the atom for the string, adding it to its shard if it hasn't been
+    seen before. Atoms are the entry index in the shard, shifted left by the
+    shard bits, with the shard in the low bits.
+==============================================================================*/
+atom_t atom_table_t::intern(const char *str, size_t length)
+{
+  const atom_lookup_t key { str, length, hash64(str, length) };
+  const uint32_t shard_index = shard_bits_
+                               ? uint32_t(key.hash >> (64 - shard_bits_))
+                               : 0;
+  shard_t &shard = shards_[shard_index];
+
+  std::unique_lock<std::mutex> guard(shard.lock, std::defer_lock);
+  if (shard_bits_) {
+    guard.lock();
+  }
+
+  const auto iter = shard.index.find_as(key);
+  if (iter != shard.index.end()) {
+    return atom_t(*iter << shard_bits_) | shard_index;
+  }
+
+  const size_t index = shard.entries.size();
+  if (index > (UINT32_MAX >> shard_bits_)) {
+    s_throw(std::overflow_error, "Atom table is full");
+  }
+
+  shard.entries.push_back({ shard.store(str, length), length, key.hash });
+  shard.index.insert(uint32_t(index));
+  return atom_t(index << shard_bits_) | shard_index;
+}
+
+
+
+atom_t atom_table_t::intern(const string &str)
+{
+  return intern(str.c_str(), size_t(str.size()));
+}
+
+
+
+/*==============================================================================
+  find(str, length, out)
+
+    Same as intern, but never adds the string.
+==============================================================================*/
+bool atom_table_t::find(const char *str, size_t length, atom_t &out) const
+{
+  const atom_lookup_t key { str, length, hash64(str, length) };
+  const uint32_t shard_index = shard_bits_
+                               ? uint32_t(key.hash >> (64 - shard_bits_))
+                               : 0;
+  const shard_t &shard = shards_[shard_index];
+
+  std::unique_lock<std::mutex> guard(shard.lock, std::defer_lock);
+  if (shard_bits_) {
+    guard.lock();
+  }
+
+  const auto iter = shard.index.find_as(key);
+  if (iter == shard.index.end()) {
+    return false;
+  }
+
+  out = atom_t(*iter << shard_bits_) | shard_index;
+  return true;
+}
+
+
+
+bool atom_table_t::find(const string &str, atom_t &out) const
+{
+  return find(str.c_str(), size_t(str.size()), out);
+}
+
+
+
+/*==============================================================================
+  lookup(atom, length, hash)
+
+    Returns the string for an atom and, if length or hash are non-null, stores
+    its length and hash in them. Throws std::out_of_range if the atom wasn't
+    produced by this table.
+==============================================================================*/
+const char *atom_table_t::lookup(atom_t atom, size_t *length, uint64_t *hash) const
+{
+  const shard_t &shard = shards_[atom & ((1U << shard_bits_) - 1)];
+  const uint32_t index = atom >> shard_bits_;
+
+  std::unique_lock<std::mutex> guard(shard.lock, std::defer_lock);
+  if (shard_bits_) {
+    guard.lock();
+  }
+
+  if (index >= shard.entries.size()) {
+    s_throw(std::out_of_range, "Invalid atom %u", unsigned(atom));
+  }
+
+  const atom_entry_t &entry = shard.entries[index];
+  if (length) {
+    *length = entry.length;
+  }
+  if (hash) {
+    *hash = entry.hash;
+  }
+  return entry.str;
+}
+
+
+
+const char *atom_table_t::c_str(atom_t atom) const
+{
+  return lookup(atom, nullptr, nullptr);
+}
+
+
+
+size_t atom_table_t::length(atom_t atom) const
+{
+  size_t length = 0;
+  lookup(atom, &length, nullptr);
+  return length;
+}
+
+
+
+string atom_table_t::str(atom_t atom) const
+{
+  size_t length = 0;
+  const char *str = lookup(atom, &length, nullptr);
+  return string(str, string::size_type(length));
+}
+
+
+
+uint64_t atom_table_t::hash(atom_t atom) const
+{
+  uint64_t hash = 0;
+  lookup(atom, nullptr, &hash);
+  return hash;
+}
+
+
+
+/*==============================================================================
+  size()
+
+    Returns the total number of entries across all shards. In a thread-safe
+    table this is only a snapshot -- other threads may be interning strings
+    while it's counted.
+==============================================================================*/
+size_t atom_table_t::size() const
+{
+  const size_t shard_count = size_t(1) << shard_bits_;
+  size_t total = 0;
+  for (size_t shard_index = 0; shard_index < shard_count; ++shard_index) {
+    const shard_t &shard = shards_[shard_index];
+    std::unique_lock<std::mutex> guard(shard.lock, std::defer_lock);
+    if (shard_bits_) {
+      guard.lock();
+    }
+    total += shard.entries.size();
+  }
+  return total;
+}
+
+
+} // namespace snow
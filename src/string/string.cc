@@ -234,7 +234,7 @@ string_t &string_t::operator = (string_t &&other)
   }
 
   if (can_free()) {
-    delete [] data_;
+    free(data_);
   }
 
   data_ = other.data_;
@@ -633,7 +633,7 @@ string_t &string_t::shrink_to_fit()
     std::memcpy(rep_.short_.short_data_, data_, len);
 
     if (old_cap) {
-      delete [] data_;
+      free(data_);
     }
 
     rep_.short_.length_ = len;
@@ -669,6 +669,7 @@ string_t &string_t::reserve(size_type const requested_capacity)
     }
 
     data_ = new_buffer;
+    rep_.long_.capacity_ = requested_capacity;
   } else {
     char *new_buffer = (char *)std::malloc(requested_capacity);
     // How the hell should you handle this, anyway?